@@ -0,0 +1,191 @@
+// Benchmark for src/include/bvh.h over synthetic boxes: build, refit, and frustum and
+// ray queries against testing every box
+#define _USE_MATH_DEFINES
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/include/bvh.h"
+#include "../src/include/random.h"
+
+randomState state;
+
+float uniform(float lo, float hi) {
+	double v;
+	fillUniform(&state, &v, 1, lo, hi);
+	return v;
+}
+
+vec3 randomPoint(float extent) {
+	return { uniform(-extent, extent), uniform(-extent, extent), uniform(-extent, extent) };
+}
+
+// Clustered like a scene: groups of parts around a few hundred anchors
+aabb randomBox(const std::vector<vec3>& anchors) {
+	const vec3 c = anchors[(size_t)uniform(0, anchors.size())] + randomPoint(20);
+	const vec3 half = { uniform(0.1, 2), uniform(0.1, 2), uniform(0.1, 2) };
+	return { c - half, c + half };
+}
+
+// Milliseconds per run, repeating until it has taken a while
+template <typename F>
+double timeRuns(F run) {
+	using clock = std::chrono::steady_clock;
+	run();
+	int runs = 0;
+	const auto start = clock::now();
+	double elapsed;
+	do {
+		run();
+		runs++;
+		elapsed = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	} while (elapsed < 500);
+	return elapsed / runs;
+}
+
+// Nearest box the ray enters, by testing all of them
+bool nearestBox(const std::vector<aabb>& boxes, vec3 origin, vec3 direction, float* distance, uint32_t* item) {
+	const vec3 inverse = { 1 / direction.x, 1 / direction.y, 1 / direction.z };
+	bool hit = false;
+	for (uint32_t i = 0; i < boxes.size(); i++) {
+		const float t = rayEntry(boxes[i], origin, inverse, *distance);
+		if (t >= *distance) continue;
+		*distance = t;
+		*item = i;
+		hit = true;
+	}
+	return hit;
+}
+
+// Same visible sets as testing every box, counting the boxes seen over all views
+bool matchFrustums(const bvh& tree, const std::vector<aabb>& boxes, const std::vector<frustum>& frustums,
+				   size_t* visible) {
+	std::vector<uint32_t> found, expected;
+	for (const auto& f : frustums) {
+		found.clear();
+		expected.clear();
+		frustumQuery(tree, f, &found);
+		for (uint32_t i = 0; i < boxes.size(); i++)
+			if (inFrustum(f, boxes[i])) expected.push_back(i);
+		std::sort(found.begin(), found.end());
+		if (found != expected) {
+			fprintf(stderr, "Unable to match the linear frustum test: %zu against %zu boxes\n", found.size(), expected.size());
+			return false;
+		}
+		*visible += found.size();
+	}
+	return true;
+}
+
+// Same nearest hits as testing every box, counting the rays that hit
+bool matchRays(const bvh& tree, const std::vector<aabb>& boxes, const std::vector<vec3>& origins,
+			   const std::vector<vec3>& directions, uint32_t* hits) {
+	for (uint32_t r = 0; r < origins.size(); r++) {
+		float treeDistance = INFINITY, linearDistance = INFINITY;
+		uint32_t treeItem = 0, linearItem = 0;
+		const bool treeHit = rayQuery(tree, origins[r], directions[r], &treeDistance, &treeItem);
+		const bool linearHit = nearestBox(boxes, origins[r], directions[r], &linearDistance, &linearItem);
+		if (treeHit != linearHit || treeDistance != linearDistance) {
+			fprintf(stderr, "Unable to match the linear ray test on ray %u\n", r);
+			return false;
+		}
+		*hits += treeHit;
+	}
+	return true;
+}
+
+int main() {
+	seedRandom(&state, 1);
+	constexpr uint32_t count = 100000, views = 64, rays = 256;
+	std::vector<vec3> anchors(500);
+	for (auto& a : anchors) a = randomPoint(500);
+	std::vector<aabb> boxes(count);
+	std::vector<uint32_t> ids(count);
+	for (uint32_t i = 0; i < count; i++) {
+		boxes[i] = randomBox(anchors);
+		ids[i] = i;
+	}
+
+	std::vector<frustum> frustums(views);
+	for (auto& f : frustums) {
+		const vec3 eye = randomPoint(400);
+		f = viewFrustum(perspective(60, 4.0 / 3, 0.1, 300) * lookAt(eye, eye + randomPoint(1), { 0, 1, 0 }));
+	}
+	std::vector<vec3> origins(rays), directions(rays);
+	for (uint32_t r = 0; r < rays; r++) {
+		origins[r] = randomPoint(600);
+		directions[r] = normalize(anchors[r % anchors.size()] - origins[r]);
+	}
+
+	bvh tree;
+	const double build = timeRuns([&] { buildBvh(&tree, boxes.data(), ids.data(), count); });
+	uint32_t leaves = 0;
+	for (const auto& node : tree.nodes) leaves += node.count > 0;
+	printf("%u boxes, %zu nodes, %u leaves\n", count, tree.nodes.size(), leaves);
+	printf("%-26s %10.3f ms\n", "SAH build", build);
+
+	// A tenth of the boxes move a little, like the animated parts of a scene
+	std::vector<aabb> moved = boxes;
+	for (uint32_t i = 0; i < count; i += 10) {
+		const vec3 offset = randomPoint(0.5);
+		moved[i] = { moved[i].lo + offset, moved[i].hi + offset };
+	}
+	bool flip = false;
+	const double refit = timeRuns([&] {
+		refitBvh(&tree, (flip = !flip) ? moved.data() : boxes.data());
+	});
+	printf("%-26s %10.3f ms\n", "refit", refit);
+
+	// The refitted tree has to answer like a scan over the moved boxes
+	size_t visible = 0;
+	uint32_t hits = 0;
+	refitBvh(&tree, moved.data());
+	if (!matchFrustums(tree, moved, frustums, &visible) || !matchRays(tree, moved, origins, directions, &hits))
+		return 1;
+	refitBvh(&tree, boxes.data());
+
+	// Same visible sets both ways, then the time per view
+	visible = 0;
+	if (!matchFrustums(tree, boxes, frustums, &visible)) return 1;
+	std::vector<uint32_t> found;
+	volatile size_t sink = 0;
+	const double frustumLinear = timeRuns([&] {
+		for (const auto& f : frustums) {
+			size_t kept = 0;
+			for (uint32_t i = 0; i < count; i++) kept += inFrustum(f, boxes[i]);
+			sink = sink + kept;
+		}
+	}) / views;
+	const double frustumTree = timeRuns([&] {
+		for (const auto& f : frustums) {
+			found.clear();
+			frustumQuery(tree, f, &found);
+			sink = sink + found.size();
+		}
+	}) / views;
+	printf("%-26s %10.3f ms %10.3f ms %8.2fx  (%zu boxes in view on average)\n", "frustum query (linear, bvh)",
+		   frustumLinear, frustumTree, frustumLinear / frustumTree, visible / views);
+
+	hits = 0;
+	if (!matchRays(tree, boxes, origins, directions, &hits)) return 1;
+	const double rayLinear = timeRuns([&] {
+		for (uint32_t r = 0; r < rays; r++) {
+			float distance = INFINITY;
+			uint32_t item = 0;
+			nearestBox(boxes, origins[r], directions[r], &distance, &item);
+			sink = sink + item;
+		}
+	}) / rays;
+	const double rayTree = timeRuns([&] {
+		for (uint32_t r = 0; r < rays; r++) {
+			float distance = INFINITY;
+			uint32_t item = 0;
+			rayQuery(tree, origins[r], directions[r], &distance, &item);
+			sink = sink + item;
+		}
+	}) / rays;
+	printf("%-26s %10.3f ms %10.3f ms %8.2fx  (%u of %u rays hit)\n", "ray query (linear, bvh)", rayLinear, rayTree,
+		   rayLinear / rayTree, hits, rays);
+	return 0;
+}
\ No newline at end of file
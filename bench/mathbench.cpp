@@ -0,0 +1,106 @@
+// Micro-benchmarks for src/include/vecmath.h: SSE kernels against the scalar reference
+#define _USE_MATH_DEFINES
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include "../src/include/vecmath.h"
+#include "../src/include/random.h"
+
+randomState state;
+
+float uniform(float lo, float hi) {
+	double v;
+	fillUniform(&state, &v, 1, lo, hi);
+	return v;
+}
+
+mat4 randomTransform() {
+	const quat q = axisAngle(uniform(-180, 180), { uniform(-1, 1), uniform(-1, 1), uniform(-1, 1) });
+	return compose({ uniform(-10, 10), uniform(-10, 10), uniform(-10, 10) }, q,
+				   { uniform(0.1, 4), uniform(0.1, 4), uniform(0.1, 4) });
+}
+
+float maxError(const float* a, const float* b, size_t count) {
+	float error = 0;
+	for (size_t i = 0; i < count; i++) error = fmaxf(error, fabsf(a[i] - b[i]) / fmaxf(1, fabsf(b[i])));
+	return error;
+}
+
+// Runs a kernel until it has taken a while, returns nanoseconds per call
+template <typename F>
+double timeKernel(F kernel, int calls) {
+	using clock = std::chrono::steady_clock;
+	kernel();
+	int runs = 0;
+	const auto start = clock::now();
+	double elapsed;
+	do {
+		kernel();
+		runs++;
+		elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+	} while (elapsed < 2e8);
+	return elapsed / runs / calls;
+}
+
+void report(const char* name, double scalarNs, double simdNs, float error) {
+	printf("%-18s %10.2f %10.2f %8.2fx %12.2e\n", name, scalarNs, simdNs, scalarNs / simdNs, error);
+}
+
+int main() {
+	seedRandom(&state, 1);
+	constexpr int matrices = 4096, points = 1 << 20;
+	std::vector<mat4> a(matrices), b(matrices), scalarOut(matrices), simdOut(matrices);
+	for (int i = 0; i < matrices; i++) {
+		a[i] = randomTransform();
+		b[i] = perspective(uniform(30, 90), uniform(0.5, 2), 0.1, 200) * randomTransform();
+	}
+	std::vector<vec3> in(points);
+	for (auto& p : in) p = { uniform(-100, 100), uniform(-100, 100), uniform(-100, 100) };
+	std::vector<vec4> scalarPoints(points), simdPoints(points);
+
+#ifdef VECMATH_SSE
+	printf("SSE kernels\n");
+#else
+	printf("No SSE, both columns run the scalar path\n");
+#endif
+	printf("%-18s %10s %10s %9s %12s\n", "kernel", "scalar ns", "simd ns", "speedup", "max rel err");
+
+	volatile float sink = 0;
+	const double multiplyScalar = timeKernel([&] {
+		for (int i = 0; i < matrices; i++) scalarOut[i] = scalar::multiply(a[i], b[i]);
+		sink = sink + scalarOut[matrices - 1].m[0];
+	}, matrices);
+	const double multiplySimd = timeKernel([&] {
+		for (int i = 0; i < matrices; i++) simdOut[i] = a[i] * b[i];
+		sink = sink + simdOut[matrices - 1].m[0];
+	}, matrices);
+	report("mat4 multiply", multiplyScalar, multiplySimd, maxError(simdOut[0].m, scalarOut[0].m, 16 * matrices));
+
+	const double inverseScalar = timeKernel([&] {
+		for (int i = 0; i < matrices; i++) scalarOut[i] = scalar::inverse(b[i]);
+		sink = sink + scalarOut[matrices - 1].m[0];
+	}, matrices);
+	const double inverseSimd = timeKernel([&] {
+		for (int i = 0; i < matrices; i++) simdOut[i] = inverse(b[i]);
+		sink = sink + simdOut[matrices - 1].m[0];
+	}, matrices);
+	float identityError = 0;
+	for (int i = 0; i < matrices; i++) {
+		const mat4 product = b[i] * simdOut[i], unit = identity();
+		identityError = fmaxf(identityError, maxError(product.m, unit.m, 16));
+	}
+	report("mat4 inverse", inverseScalar, inverseSimd, maxError(simdOut[0].m, scalarOut[0].m, 16 * matrices));
+	printf("%-18s %45.2e\n", "  m * inverse(m)", identityError);
+
+	const double pointsScalar = timeKernel([&] {
+		scalar::transformPoints(b[0], in.data(), scalarPoints.data(), points);
+		sink = sink + scalarPoints[points - 1].x;
+	}, points);
+	const double pointsSimd = timeKernel([&] {
+		transformPoints(b[0], in.data(), simdPoints.data(), points);
+		sink = sink + simdPoints[points - 1].x;
+	}, points);
+	report("transform points", pointsScalar, pointsSimd, maxError(&simdPoints[0].x, &scalarPoints[0].x, 4 * points));
+	return 0;
+}
@@ -77,8 +77,44 @@ RgbImage::RgbImage(const RgbImage *image) {
  *  Return true for success, false for failure.  Error code is available
  *     with a separate call.
  *  Author: Sam Buss December 2001.
+ *  Modified: the pixel block is read with a single fread and converted
+ *     row by row; top-down and 32-bit BGRA bitmaps are also accepted.
  **********************************************************************/
 
+#ifndef BI_BITFIELDS
+#define BI_BITFIELDS 3
+#endif
+
+static unsigned long getLong( const unsigned char* p )
+{
+	return p[0] | (p[1]<<8) | (p[2]<<16) | ((unsigned long)p[3]<<24);
+}
+
+static unsigned short getShort( const unsigned char* p )
+{
+	return p[0] | (p[1]<<8);
+}
+
+// Row kernels: plain indexed loops over independent pixels so the
+// compiler can vectorise them.
+static void bgrToRgbRow( const unsigned char* src, unsigned char* dst, long numCols )
+{
+	for ( long j=0; j<numCols; j++ ) {
+		dst[3*j]   = src[3*j+2];
+		dst[3*j+1] = src[3*j+1];
+		dst[3*j+2] = src[3*j];
+	}
+}
+
+static void bgraToRgbRow( const unsigned char* src, unsigned char* dst, long numCols )
+{
+	for ( long j=0; j<numCols; j++ ) {
+		dst[3*j]   = src[4*j+2];
+		dst[3*j+1] = src[4*j+1];
+		dst[3*j+2] = src[4*j];
+	}
+}
+
 bool RgbImage::LoadBmpFile( const char* filename ) 
 {  
 	Reset();
@@ -89,34 +125,51 @@ bool RgbImage::LoadBmpFile( const char* filename )
 		return false;
 	}
 
+	// File header (14 bytes), info header (40 bytes) and the BI_BITFIELDS masks
+	unsigned char header[66] = { 0 };
+	size_t headerRead = fread( header, 1, sizeof(header), infile );
+
 	bool fileFormatOK = false;
-	int bChar = fgetc( infile );
-	int mChar = fgetc( infile );
-	if ( bChar=='B' && mChar=='M' ) {			// If starts with "BM" for "BitMap"
-		skipChars(infile, 4 + 2 + 2);			// Skip 3 fields (size of file and two reserved fields)
-		int offset = readLong(infile);			// Offset to the bitmap table
-		int headerSize = readLong(infile);		// Size of the Bitmap header
-		NumCols = readLong( infile );
-		NumRows = readLong( infile );
-		skipChars( infile, 2 );					// Skip one field (number of color planes)
-		int bitsPerPixel = readShort( infile );
-		int bytesRead = 30;						// 2 + 4 + 2 + 2 + 4 + 4 + 4 + 4 + 2 + 2
+	bool topDown = false;
+	int bitsPerPixel = 0;
+	unsigned long offset = 0;
+	if ( headerRead>=26 && header[0]=='B' && header[1]=='M' ) {	// If starts with "BM" for "BitMap"
+		offset = getLong( header+10 );			// Offset to the bitmap table
+		unsigned long headerSize = getLong( header+14 );	// Size of the Bitmap header
+		long height;
 		int compressionMethod = BI_RGB;
-		if (headerSize >= 40) {
-			compressionMethod = readLong(infile);
-			bytesRead += 4;
+		if ( headerSize==12 ) {					// OS/2 core header: 16 bit dimensions
+			NumCols = getShort( header+18 );
+			height = getShort( header+20 );
+			bitsPerPixel = getShort( header+24 );
+		}
+		else {
+			NumCols = (int)getLong( header+18 );
+			height = (int)getLong( header+22 );
+			bitsPerPixel = getShort( header+28 );
+			if ( headerSize>=40 && headerRead>=54 ) {
+				compressionMethod = getLong( header+30 );
+			}
+		}
+		topDown = height<0;
+		NumRows = topDown ? -height : height;
+
+		// 32 bit images may declare their channel masks; only BGRA order is supported
+		if ( compressionMethod==BI_BITFIELDS && bitsPerPixel==32 && headerRead>=66
+			&& getLong( header+54 )==0x00ff0000 && getLong( header+58 )==0x0000ff00
+			&& getLong( header+62 )==0x000000ff ) {
+			compressionMethod = BI_RGB;
 		}
-		skipChars(infile, offset - bytesRead);
 
 		if ( NumCols>0 && NumCols<=100000 && NumRows>0 && NumRows<=100000  
-			&& bitsPerPixel==24 && compressionMethod ==BI_RGB && !feof(infile) ) {
+			&& (bitsPerPixel==24 || bitsPerPixel==32) && compressionMethod==BI_RGB ) {
 			fileFormatOK = true;
 		}
 	}
 	if ( !fileFormatOK ) {
 		Reset();
 		ErrorCode = FileFormatError;
-		fprintf(stderr, "Not a valid 24-bit, BI_RGB, bitmap file: %s.\n", filename);
+		fprintf(stderr, "Not a valid 24/32-bit, BI_RGB, bitmap file: %s.\n", filename);
 		fclose ( infile );
 		return false;
 	}
@@ -127,29 +180,38 @@ bool RgbImage::LoadBmpFile( const char* filename )
 		return false;
 	}
 
-	unsigned char* cPtr = ImagePtr;
-	for ( int i=0; i<NumRows; i++ ) {
-		int j;
-		for ( j=0; j<NumCols; j++ ) {
-			*(cPtr+2) = (unsigned char)fgetc( infile );	// Blue color value
-			*(cPtr+1) = (unsigned char)fgetc( infile );	// Green color value
-			*cPtr = (unsigned char)fgetc( infile );		// Red color value
-			cPtr += 3;
-		}
-		int k=3*NumCols;					// Num bytes already read
-		for ( ; k<GetNumBytesPerRow(); k++ ) {
-			fgetc( infile );				// Read and ignore padding;
-			*(cPtr++) = 0;
-		}
-	}
-	if ( feof( infile ) ) {
+	// Read the whole pixel block at once
+	const long srcBytesPerRow = ((bitsPerPixel/8*NumCols+3)>>2)<<2;
+	const long blockSize = srcBytesPerRow*NumRows;
+	unsigned char* block = new unsigned char[blockSize];
+	if ( fseek( infile, offset, SEEK_SET )!=0
+		|| (long)fread( block, 1, blockSize, infile )!=blockSize ) {
 		fprintf( stderr, "Premature end of file: %s.\n", filename );
+		delete[] block;
 		Reset();
 		ErrorCode = ReadError;
 		fclose ( infile );
 		return false;
 	}
 	fclose( infile );	// Close the file
+
+	// Rows are stored bottom up unless the height was negative
+	const long rowLen = GetNumBytesPerRow();
+	for ( long i=0; i<NumRows; i++ ) {
+		const unsigned char* src = block + (topDown ? NumRows-1-i : i)*srcBytesPerRow;
+		unsigned char* dst = ImagePtr + i*rowLen;
+		if ( bitsPerPixel==24 ) {
+			bgrToRgbRow( src, dst, NumCols );
+		}
+		else {
+			bgraToRgbRow( src, dst, NumCols );
+		}
+		for ( long k=3*NumCols; k<rowLen; k++ ) {
+			dst[k] = 0;					// Zero the padding
+		}
+	}
+	delete[] block;
+
 	ErrorCode = NoError;
 	return true;
 }
@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cmath>
+
+#include "include/bvh.h"
+
+constexpr int bins = 12;	// Candidate split planes per axis are the bin borders
+constexpr uint32_t maxLeaf = 8;	// Leaves this small may stay when splitting doesn't pay
+constexpr int maxDepth = 60;	// Deeper ranges become leaves, keeps the query stacks fixed
+
+const aabb emptyBox = { { INFINITY, INFINITY, INFINITY }, { -INFINITY, -INFINITY, -INFINITY } };
+
+void grow(aabb* box, const aabb& other) {
+	box->lo = { std::min(box->lo.x, other.lo.x), std::min(box->lo.y, other.lo.y), std::min(box->lo.z, other.lo.z) };
+	box->hi = { std::max(box->hi.x, other.hi.x), std::max(box->hi.y, other.hi.y), std::max(box->hi.z, other.hi.z) };
+}
+
+// Half the surface area, proportional to the chance a random ray or view hits the box
+float halfArea(const aabb& box) {
+	const vec3 d = box.hi - box.lo;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Twice the centre, only ever compared against itself
+float centre(const aabb& box, int axis) {
+	return (&box.lo.x)[axis] + (&box.hi.x)[axis];
+}
+
+aabb rangeBounds(const bvh& tree, uint32_t first, uint32_t count) {
+	aabb box = emptyBox;
+	for (uint32_t k = first; k < first + count; k++) grow(&box, tree.boxes[k]);
+	return box;
+}
+
+struct bvhSplit {
+	int axis = -1;
+	float position = 0;	// Items with a lesser centre go left
+	float cost = INFINITY;	// Relative to the node's own area
+};
+
+// Bins the centres on each axis and sweeps the bin borders for the least
+// left area * left count + right area * right count
+bvhSplit findSplit(const bvh& tree, const bvhNode& node) {
+	aabb centres = emptyBox;
+	for (uint32_t k = node.first; k < node.first + node.count; k++) {
+		const aabb& b = tree.boxes[k];
+		const vec3 c = b.lo + b.hi;
+		grow(&centres, { c, c });
+	}
+
+	bvhSplit best;
+	for (int axis = 0; axis < 3; axis++) {
+		const float lo = (&centres.lo.x)[axis], extent = (&centres.hi.x)[axis] - lo;
+		if (!(extent > 0)) continue;
+		const float scale = bins / extent;
+
+		aabb bounds[bins];
+		uint32_t counts[bins] = {};
+		std::fill(bounds, bounds + bins, emptyBox);
+		for (uint32_t k = node.first; k < node.first + node.count; k++) {
+			const int bin = std::min(bins - 1, (int)((centre(tree.boxes[k], axis) - lo) * scale));
+			grow(&bounds[bin], tree.boxes[k]);
+			counts[bin]++;
+		}
+
+		float rightCost[bins];
+		aabb right = emptyBox;
+		uint32_t rightCount = 0;
+		for (int bin = bins - 1; bin > 0; bin--) {
+			grow(&right, bounds[bin]);
+			rightCount += counts[bin];
+			rightCost[bin] = rightCount ? halfArea(right) * rightCount : INFINITY;
+		}
+		aabb left = emptyBox;
+		uint32_t leftCount = 0;
+		for (int bin = 0; bin < bins - 1; bin++) {
+			grow(&left, bounds[bin]);
+			leftCount += counts[bin];
+			const float cost = leftCount ? halfArea(left) * leftCount + rightCost[bin + 1] : INFINITY;
+			if (cost < best.cost) best = { axis, lo + (bin + 1) / scale, cost };
+		}
+	}
+	best.cost /= halfArea(node.box);
+	return best;
+}
+
+void buildBvh(bvh* tree, const aabb* boxes, const uint32_t* ids, uint32_t count) {
+	tree->nodes.clear();
+	tree->items.assign(ids, ids + count);
+	tree->boxes.resize(count);
+	for (uint32_t k = 0; k < count; k++) tree->boxes[k] = boxes[ids[k]];
+	if (!count) return;
+
+	tree->nodes.reserve(2 * count);
+	tree->nodes.push_back({ {}, 0, count });
+	std::vector<std::pair<uint32_t, int>> pending = { { 0, 0 } };	// Node and depth
+	while (!pending.empty()) {
+		const auto [index, depth] = pending.back();
+		pending.pop_back();
+		bvhNode node = tree->nodes[index];
+		node.box = rangeBounds(*tree, node.first, node.count);
+		tree->nodes[index].box = node.box;
+		if (node.count <= 2 || depth >= maxDepth) continue;
+
+		// Splitting costs a traversal step, a leaf one test per item
+		const bvhSplit split = findSplit(*tree, node);
+		uint32_t middle;
+		if (split.axis < 0) {
+			// All centres coincide, only the leaf size is worth splitting for
+			if (node.count <= maxLeaf) continue;
+			middle = node.first + node.count / 2;
+		} else {
+			if (1 + split.cost >= node.count && node.count <= maxLeaf) continue;
+			middle = node.first;
+			for (uint32_t k = node.first; k < node.first + node.count; k++) {
+				if (centre(tree->boxes[k], split.axis) >= split.position) continue;
+				std::swap(tree->boxes[k], tree->boxes[middle]);
+				std::swap(tree->items[k], tree->items[middle]);
+				middle++;
+			}
+			// Rounding at a bin border can leave one side empty
+			if (middle == node.first || middle == node.first + node.count) middle = node.first + node.count / 2;
+		}
+
+		const uint32_t left = tree->nodes.size();
+		tree->nodes.push_back({ {}, node.first, middle - node.first });
+		tree->nodes.push_back({ {}, middle, node.first + node.count - middle });
+		tree->nodes[index].first = left;
+		tree->nodes[index].count = 0;
+		pending.push_back({ left + 1, depth + 1 });
+		pending.push_back({ left, depth + 1 });
+	}
+}
+
+// Children come after their parents, so one backward pass sees them first
+void refitBvh(bvh* tree, const aabb* boxes) {
+	for (size_t k = 0; k < tree->items.size(); k++) tree->boxes[k] = boxes[tree->items[k]];
+	for (size_t n = tree->nodes.size(); n-- > 0;) {
+		bvhNode& node = tree->nodes[n];
+		if (node.count) {
+			node.box = rangeBounds(*tree, node.first, node.count);
+		} else {
+			node.box = tree->nodes[node.first].box;
+			grow(&node.box, tree->nodes[node.first + 1].box);
+		}
+	}
+}
+
+// Subtrees wholly in view hand over their contiguous item range without further tests
+void frustumQuery(const bvh& tree, const frustum& f, std::vector<uint32_t>* items) {
+	if (tree.nodes.empty()) return;
+	uint32_t stack[maxDepth + 2], size = 0;
+	stack[size++] = 0;
+	while (size) {
+		const bvhNode* node = &tree.nodes[stack[--size]];
+		const containment c = classify(f, node->box);
+		if (c == containment::outside) continue;
+		if (node->count) {
+			for (uint32_t k = node->first; k < node->first + node->count; k++)
+				if (c == containment::inside || inFrustum(f, tree.boxes[k])) items->push_back(tree.items[k]);
+		} else if (c == containment::inside) {
+			const bvhNode* first = node;
+			while (!first->count) first = &tree.nodes[first->first];
+			const bvhNode* last = node;
+			while (!last->count) last = &tree.nodes[last->first + 1];
+			items->insert(items->end(), tree.items.begin() + first->first, tree.items.begin() + last->first + last->count);
+		} else {
+			stack[size++] = node->first + 1;
+			stack[size++] = node->first;
+		}
+	}
+}
+
+// Distance along the ray where it enters the box (slab test)
+float rayEntry(const aabb& box, vec3 origin, vec3 inverse, float limit) {
+	float near = 0, far = limit;
+	for (int axis = 0; axis < 3; axis++) {
+		const float o = (&origin.x)[axis], d = (&inverse.x)[axis];
+		const float a = ((&box.lo.x)[axis] - o) * d, b = ((&box.hi.x)[axis] - o) * d;
+		near = fmaxf(near, fminf(a, b));
+		far = fminf(far, fmaxf(a, b));
+	}
+	return near <= far ? near : INFINITY;
+}
+
+// Nearer child first, so the hits found there cut off the farther one
+bool rayQuery(const bvh& tree, vec3 origin, vec3 direction, float* distance, uint32_t* item) {
+	if (tree.nodes.empty()) return false;
+	const vec3 inverse = { 1 / direction.x, 1 / direction.y, 1 / direction.z };
+	bool hit = false;
+	uint32_t stack[maxDepth + 2], size = 0;
+	if (rayEntry(tree.nodes[0].box, origin, inverse, *distance) < *distance) stack[size++] = 0;
+	while (size) {
+		const bvhNode& node = tree.nodes[stack[--size]];
+		if (node.count) {
+			for (uint32_t k = node.first; k < node.first + node.count; k++) {
+				const float t = rayEntry(tree.boxes[k], origin, inverse, *distance);
+				if (t >= *distance) continue;
+				*distance = t;
+				*item = tree.items[k];
+				hit = true;
+			}
+			continue;
+		}
+		uint32_t near = node.first, far = node.first + 1;
+		float tNear = rayEntry(tree.nodes[near].box, origin, inverse, *distance);
+		float tFar = rayEntry(tree.nodes[far].box, origin, inverse, *distance);
+		if (tFar < tNear) {
+			std::swap(near, far);
+			std::swap(tNear, tFar);
+		}
+		if (tFar < *distance) stack[size++] = far;
+		if (tNear < *distance) stack[size++] = near;
+	}
+	return hit;
+}
\ No newline at end of file
@@ -0,0 +1,51 @@
+#include <cmath>
+
+#include "include/culling.h"
+
+// Planes straight from the rows of the combined matrix (Gribb and Hartmann)
+frustum viewFrustum(const mat4& viewProjection) {
+	const float* m = viewProjection.m;
+	frustum f;
+	for (int i = 0; i < 6; i++) {
+		const int row = i / 2;
+		const float sign = i % 2 ? -1 : 1;
+		vec4 p = { m[3] + sign * m[row], m[7] + sign * m[4 + row], m[11] + sign * m[8 + row], m[15] + sign * m[12 + row] };
+		const float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+		f.planes[i] = { p.x / length, p.y / length, p.z / length, p.w / length };
+	}
+	return f;
+}
+
+// Centre and half extents, each world extent is the absolute matrix times the local ones
+aabb transformBounds(const mat4& transform, const aabb& box) {
+	const float* m = transform.m;
+	const vec3 centre = transformPoint(transform, (box.lo + box.hi) * 0.5f);
+	const vec3 half = (box.hi - box.lo) * 0.5f;
+	vec3 extent;
+	float* e = &extent.x;
+	for (int row = 0; row < 3; row++)
+		e[row] = fabsf(m[row]) * half.x + fabsf(m[4 + row]) * half.y + fabsf(m[8 + row]) * half.z;
+	return { centre - extent, centre + extent };
+}
+
+// The bounding sphere settles most boxes, only those straddling a plane get the
+// box's most inward corner tested against it, and its least inward one for partial
+containment classify(const frustum& f, const aabb& box) {
+	const vec3 centre = (box.lo + box.hi) * 0.5f;
+	const float radius = length(box.hi - box.lo) * 0.5f;
+	containment result = containment::inside;
+	for (const vec4& p : f.planes) {
+		const float distance = p.x * centre.x + p.y * centre.y + p.z * centre.z + p.w;
+		if (distance >= radius) continue;
+		if (distance < -radius) return containment::outside;
+		const vec3 in = { p.x > 0 ? box.hi.x : box.lo.x, p.y > 0 ? box.hi.y : box.lo.y, p.z > 0 ? box.hi.z : box.lo.z };
+		if (p.x * in.x + p.y * in.y + p.z * in.z + p.w < 0) return containment::outside;
+		const vec3 out = { p.x > 0 ? box.lo.x : box.hi.x, p.y > 0 ? box.lo.y : box.hi.y, p.z > 0 ? box.lo.z : box.hi.z };
+		if (p.x * out.x + p.y * out.y + p.z * out.z + p.w < 0) result = containment::partial;
+	}
+	return result;
+}
+
+bool inFrustum(const frustum& f, const aabb& box) {
+	return classify(f, box) != containment::outside;
+}
\ No newline at end of file
@@ -1,134 +1,186 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <map>
+
 #include "include/geometry.h"
 #include "include/palette.h"
+#include "include/profiler.h"
 
-void cube(const GLdouble* colors) {
-	const GLdouble cubeNormals[] = {
-		// Left
-		-1, 0, 0,
-		-1, 0, 0,
-		-1, 0, 0,
-		-1, 0, 0,
-		// Right
-		1, 0, 0,
-		1, 0, 0,
-		1, 0, 0,
-		1, 0, 0,
-		// Top
-		0, 1, 0,
-		0, 1, 0,
-		0, 1, 0,
-		0, 1, 0,
-		// Bottom
-		0, -1, 0,
-		0, -1, 0,
-		0, -1, 0,
-		0, -1, 0,
-		// Front
-		0, 0, 1,
-		0, 0, 1,
-		0, 0, 1,
-		0, 0, 1,
-		// Back
-		0, 0, -1,
-		0, 0, -1,
-		0, 0, -1,
-		0, 0, -1,
-	};
-	const GLdouble vertices[] = {
+meshBuffer unitCube;
+const aabb cubeBounds = { { -0.5, -0.5, -0.5 }, { 0.5, 0.5, 0.5 } };
+
+// Unit cube centred at the origin: 24 vertices (4 per face, so each face keeps
+// its own normal and texture coordinates) drawn as 12 indexed triangles
+void buildCube() {
+	const std::vector<vertex> vertices = {
 		// Left
-		-0.5, -0.5, 0.5,	// 0
-		-0.5, 0.5, 0.5,		// 1
-		-0.5, 0.5, -0.5,	// 2
-		-0.5, -0.5, -0.5,	// 3
+		{1, 0, -1, 0, 0, -0.5, -0.5, 0.5},		// 0
+		{1, 1, -1, 0, 0, -0.5, 0.5, 0.5},		// 1
+		{0, 1, -1, 0, 0, -0.5, 0.5, -0.5},		// 2
+		{0, 0, -1, 0, 0, -0.5, -0.5, -0.5},		// 3
 		// Right
-		0.5, -0.5, 0.5,		// 4
-		0.5, -0.5, -0.5,	// 5
-		0.5, 0.5, -0.5,		// 6
-		0.5, 0.5, 0.5,		// 7
+		{0, 0, 1, 0, 0, 0.5, -0.5, 0.5},		// 4
+		{1, 0, 1, 0, 0, 0.5, -0.5, -0.5},		// 5
+		{1, 1, 1, 0, 0, 0.5, 0.5, -0.5},		// 6
+		{0, 1, 1, 0, 0, 0.5, 0.5, 0.5},			// 7
 		// Top
-		-0.5, 0.5, 0.5,		// 8 = 1
-		0.5, 0.5, 0.5,		// 9 = 7
-		0.5, 0.5, -0.5,		// 10 = 6
-		-0.5, 0.5, -0.5,	// 11 = 2
+		{0, 0, 0, 1, 0, -0.5, 0.5, 0.5},		// 8 = 1
+		{1, 0, 0, 1, 0, 0.5, 0.5, 0.5},			// 9 = 7
+		{1, 1, 0, 1, 0, 0.5, 0.5, -0.5},		// 10 = 6
+		{0, 1, 0, 1, 0, -0.5, 0.5, -0.5},		// 11 = 2
 		// Bottom
-		-0.5, -0.5, 0.5,	// 12 = 0
-		-0.5, -0.5, -0.5,	// 13 = 3
-		0.5, -0.5, -0.5,	// 14 = 5
-		0.5, -0.5, 0.5,		// 15 = 4
+		{0, 1, 0, -1, 0, -0.5, -0.5, 0.5},		// 12 = 0
+		{0, 0, 0, -1, 0, -0.5, -0.5, -0.5},		// 13 = 3
+		{1, 0, 0, -1, 0, 0.5, -0.5, -0.5},		// 14 = 5
+		{1, 1, 0, -1, 0, 0.5, -0.5, 0.5},		// 15 = 4
 		// Front
-		-0.5, -0.5, 0.5,	// 16 = 0
-		0.5, -0.5, 0.5,		// 17 = 4
-		0.5, 0.5, 0.5,		// 18 = 7
-		-0.5, 0.5, 0.5,		// 19 = 1
+		{0, 0, 0, 0, 1, -0.5, -0.5, 0.5},		// 16 = 0
+		{1, 0, 0, 0, 1, 0.5, -0.5, 0.5},		// 17 = 4
+		{1, 1, 0, 0, 1, 0.5, 0.5, 0.5},			// 18 = 7
+		{0, 1, 0, 0, 1, -0.5, 0.5, 0.5},		// 19 = 1
 		// Back
-		0.5, 0.5, -0.5,		// 20 = 6
-		0.5, -0.5, -0.5,	// 21 = 5
-		-0.5, -0.5, -0.5,	// 22 = 3
-		-0.5, 0.5, -0.5		// 23 = 2
+		{1, 1, 0, 0, -1, 0.5, 0.5, -0.5},		// 20 = 6
+		{1, 0, 0, 0, -1, 0.5, -0.5, -0.5},		// 21 = 5
+		{0, 0, 0, 0, -1, -0.5, -0.5, -0.5},		// 22 = 3
+		{0, 1, 0, 0, -1, -0.5, 0.5, -0.5}		// 23 = 2
 	};
-	const GLdouble textures[] = {
-		// Left
-		1, 0,	// 0
-		1, 1,	// 1
-		0, 1,	// 2
-		0, 0,	// 3
-		// Right
-		0, 0,	// 4
-		1, 0,	// 5
-		1, 1,	// 6
-		0, 1,	// 7
-		// Top
-		0, 0,	// 8 = 1
-		1, 0,	// 9 = 7
-		1, 1,	// 10 = 6
-		0, 1,	// 11 = 2
-		// Bottom
-		0, 1,	// 12 = 0
-		0, 0,	// 13 = 3
-		1, 0,	// 14 = 5
-		1, 1,	// 15 = 4
-		// Front
-		0, 0,	// 16 = 0
-		1, 0,	// 17 = 4
-		1, 1,	// 18 = 7
-		0, 1,	// 19 = 1
-		// Back
-		0, 1,	// 20 = 6
-		0, 0,	// 21 = 5
-		1, 0,	// 22 = 3
-		1, 1,	// 23 = 2
 
-	};
+	std::vector<GLuint> indices;
+	for (GLuint face = 0; face < 6; face++) {
+		const GLuint first = face * 4;
+		for (GLuint i : {0, 1, 2, 0, 2, 3}) indices.push_back(first + i);
+	}
+
+	uploadMesh(&unitCube, vertices, indices, GL_TRIANGLES);
+}
+
+const meshBuffer* cube(const lodView&, const GLfloat*) {
+	if (!unitCube.count) buildCube();
+	return &unitCube;
+}
+
+std::map<std::pair<GLint, GLint>, meshBuffer> cylinders;
+const aabb cylinderBounds = { { -1, -0.5, -1 }, { 1, 0.5, 1 } };
+
+// Cylinder of radius 1 and height 1 centred at the origin, along the Y axis
+void buildCylinder(meshBuffer* mesh, GLint slices, GLint stacks) {
+	std::vector<vertex> vertices;
+	std::vector<GLuint> indices;
+
+	// Side
+	for (int i = 0; i <= stacks; i++) {
+		const GLfloat y = (GLfloat)i / stacks - 0.5f;
+		for (int j = 0; j <= slices; j++) {
+			const GLfloat angle = 2 * M_PI * j / slices;
+			const GLfloat x = sin(angle), z = cos(angle);
+			vertices.push_back({(GLfloat)j / slices, (GLfloat)i / stacks, x, 0, z, x, y, z});
+		}
+	}
+	for (int i = 0; i < stacks; i++)
+		for (int j = 0; j < slices; j++) {
+			const GLuint a = i * (slices + 1) + j, b = a + 1, c = a + slices + 1, d = c + 1;
+			indices.insert(indices.end(), {a, b, d, a, d, c});
+		}
+
+	// Caps (top then bottom), each as a fan around its centre
+	for (int side = 1; side >= -1; side -= 2) {
+		const GLuint centre = vertices.size();
+		const GLfloat y = 0.5f * side;
+		vertices.push_back({0.5, 0.5, 0, (GLfloat)side, 0, 0, y, 0});
+		for (int j = 0; j <= slices; j++) {
+			const GLfloat angle = 2 * M_PI * j / slices;
+			const GLfloat x = sin(angle), z = cos(angle);
+			vertices.push_back({0.5f + 0.5f * x, 0.5f + 0.5f * z, 0, (GLfloat)side, 0, x, y, z});
+		}
+		for (int j = 0; j < slices; j++) {
+			const GLuint a = centre + 1 + j, b = a + 1;
+			if (side > 0) indices.insert(indices.end(), {centre, a, b});
+			else indices.insert(indices.end(), {centre, b, a});
+		}
+	}
+
+	uploadMesh(mesh, vertices, indices, GL_TRIANGLES);
+}
+
+// Cached cylinder meshes, built once per (slices, stacks) pair
+const meshBuffer* cylinderMesh(GLint slices, GLint stacks) {
+	auto& mesh = cylinders[{slices, stacks}];
+	if (!mesh.count) buildCylinder(&mesh, slices, stacks);
+	return &mesh;
+}
+
+lodView lodFor(const GLfloat* projection, GLint viewportHeight) {
+	return { (GLdouble)projection[5] * viewportHeight / 2, projection[11] != 0 };
+}
+
+// Radius in pixels of a sphere centred at the modelview origin
+GLdouble projectedSize(const lodView& view, const GLfloat* modelview, GLdouble radius) {
+	// Largest axis scale of the modelview
+	GLdouble scale = 0;
+	for (int i = 0; i < 3; i++) {
+		const GLfloat* axis = modelview + 4 * i;
+		scale = fmax(scale, sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]));
+	}
+
+	GLdouble size = radius * scale * view.pixels;
+	if (view.perspective) {	// Perspective divide
+		const GLdouble depth = -modelview[14];
+		if (depth <= radius * scale) return INFINITY;
+		size /= depth;
+	}
+	return size;
+}
+
+// Cylinder levels of detail, picked by projected radius in pixels
+const struct {
+	GLdouble maxPixels;
+	GLint slices, stacks;
+} cylinderLods[] = {
+	{ 4, 8, 1 },
+	{ 16, 24, 4 },
+	{ 48, 36, 12 },
+	{ INFINITY, 50, 50 }
+};
+
+const meshBuffer* cylinder(const lodView& view, const GLfloat* modelview) {
+	const GLdouble size = projectedSize(view, modelview, sqrt(1.25));
+	int lod = 0;
+	while (size > cylinderLods[lod].maxPixels) lod++;
+	return cylinderMesh(cylinderLods[lod].slices, cylinderLods[lod].stacks);
+}
+
+GLfloat CUBE_WHITE[] = { WHITE };
+
+void uploadMesh(meshBuffer* mesh, const std::vector<vertex>& vertices, const std::vector<GLuint>& indices, GLenum mode) {
+	if (!mesh->vbo) glGenBuffers(1, &mesh->vbo);
+	if (!mesh->ibo) glGenBuffers(1, &mesh->ibo);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), vertices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	mesh->count = indices.size();
+	mesh->vertices = vertices.size();
+	mesh->mode = mode;
+}
 
-	const GLuint left[] = { 0, 1, 2, 3 };
-	const GLuint right[] = { 4, 5, 6, 7 };
-	const GLuint top[] = { 8, 9, 10, 11 };
-	const GLuint bottom[] = { 12, 13, 14, 15 };
-	const GLuint front[] = { 16, 17, 18, 19 };
-	const GLuint back[] = { 6, 5, 3, 2 };
-
-	glVertexPointer(3, GL_DOUBLE, 0, vertices);
-	glEnableClientState(GL_VERTEX_ARRAY);
-	glNormalPointer(GL_DOUBLE, 0, cubeNormals);
-	glEnableClientState(GL_NORMAL_ARRAY);
-	glColorPointer(4, GL_DOUBLE, 0, colors);
-	glEnableClientState(GL_COLOR_ARRAY);
-	glTexCoordPointer(2, GL_DOUBLE, 0, textures);
-	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-
-	glDrawElements(GL_POLYGON, 4, GL_UNSIGNED_INT, left);
-	glDrawElements(GL_POLYGON, 4, GL_UNSIGNED_INT, right);
-	glDrawElements(GL_POLYGON, 4, GL_UNSIGNED_INT, top);
-	glDrawElements(GL_POLYGON, 4, GL_UNSIGNED_INT, bottom);
-	glDrawElements(GL_POLYGON, 4, GL_UNSIGNED_INT, front);
-	glDrawElements(GL_POLYGON, 4, GL_UNSIGNED_INT, back);
+void freeMesh(meshBuffer* mesh) {
+	if (mesh->vbo) glDeleteBuffers(1, &mesh->vbo);
+	if (mesh->ibo) glDeleteBuffers(1, &mesh->ibo);
+	*mesh = meshBuffer();
 }
 
-GLdouble CUBE_WHITE[] = {
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE
-};
\ No newline at end of file
+// Buffers are unbound afterwards so client-side arrays keep working
+void drawMesh(const meshBuffer* mesh, GLsizei instances) {
+	if (!mesh->count || !instances) return;
+	glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->ibo);
+	glInterleavedArrays(GL_T2F_N3F_V3F, 0, 0);
+	glDrawElementsInstanced(mesh->mode, mesh->count, GL_UNSIGNED_INT, 0, instances);
+	countVertices(mesh->vertices * instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <cerrno>
+#include <sys/stat.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/freeglut.h>
+
+#include "include/headless.h"
+#include "include/RgbImage.h"
+
+struct {
+	int width, height;
+	EGLDisplay display;
+	EGLContext context;
+	GLuint framebuffer, color, depth;
+} offscreen;
+
+// Creates a desktop GL context without a surface and renders into a framebuffer object
+bool initHeadless(int width, int height) {
+	offscreen.width = width;
+	offscreen.height = height;
+
+	offscreen.display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (offscreen.display == EGL_NO_DISPLAY) offscreen.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (offscreen.display == EGL_NO_DISPLAY || !eglInitialize(offscreen.display, NULL, NULL)) {
+		fprintf(stderr, "Unable to initialise EGL.\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "EGL has no desktop OpenGL support.\n");
+		return false;
+	}
+
+	// Surfaceless platforms may expose no configs at all
+	const EGLint attributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	EGLConfig config = EGL_NO_CONFIG_KHR;
+	EGLint configs = 0;
+	eglChooseConfig(offscreen.display, attributes, &config, 1, &configs);
+	if (!configs) config = EGL_NO_CONFIG_KHR;
+
+	offscreen.context = eglCreateContext(offscreen.display, config, EGL_NO_CONTEXT, NULL);
+	if (offscreen.context == EGL_NO_CONTEXT
+		|| !eglMakeCurrent(offscreen.display, EGL_NO_SURFACE, EGL_NO_SURFACE, offscreen.context)) {
+		fprintf(stderr, "Unable to create a surfaceless OpenGL context.\n");
+		return false;
+	}
+
+	glGenRenderbuffers(1, &offscreen.color);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreen.color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &offscreen.depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, offscreen.depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &offscreen.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, offscreen.framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen.color);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreen.depth);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Offscreen framebuffer is incomplete.\n");
+		return false;
+	}
+
+	fprintf(stderr, "Headless %dx%d: %s\n", width, height, glGetString(GL_RENDERER));
+	return true;
+}
+
+// Writes the framebuffer to <dir>/frameNNNN.bmp
+bool dumpFrame(const char* dir, int frame) {
+	static RgbImage image;
+	if (frame == 0 && mkdir(dir, 0755) && errno != EEXIST) {
+		fprintf(stderr, "Unable to create directory: %s\n", dir);
+		return false;
+	}
+
+	// RgbImage reads back the current viewport
+	glViewport(0, 0, offscreen.width, offscreen.height);
+	if (!image.LoadFromOpenglBuffer()) return false;
+
+	char filename[FILENAME_MAX];
+	snprintf(filename, sizeof filename, "%s/frame%04d.bmp", dir, frame);
+	return image.WriteBmpFile(filename);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "culling.h"
+
+// A leaf holds count items from first in the item list, an inner node (count 0)
+// has its two children at first and first + 1
+struct bvhNode {
+	aabb box;
+	uint32_t first, count;
+};
+
+// Bounding volume hierarchy over item boxes. Children always come after their
+// parent and every subtree's items are contiguous in leaf order.
+struct bvh {
+	std::vector<bvhNode> nodes;
+	std::vector<uint32_t> items;	// Item ids in leaf order
+	std::vector<aabb> boxes;	// Their boxes, in the same order
+};
+
+void buildBvh(bvh*, const aabb* boxes, const uint32_t* ids, uint32_t count);	// Binned SAH, boxes indexed by id
+void refitBvh(bvh*, const aabb* boxes);	// Same tree over the same ids, boxes indexed by id
+void frustumQuery(const bvh&, const frustum&, std::vector<uint32_t>* items);	// Appends the ids of the boxes in view
+float rayEntry(const aabb&, vec3 origin, vec3 inverseDirection, float limit);	// Infinity if not before limit
+bool rayQuery(const bvh&, vec3 origin, vec3 direction, float* distance, uint32_t* item);	// Nearest box entered before *distance
\ No newline at end of file
@@ -0,0 +1,27 @@
+#pragma once
+#include <GL/freeglut.h>
+#include "vecmath.h"
+
+// Axis-aligned bounding box
+struct aabb {
+	vec3 lo, hi;
+};
+
+// Inward facing planes (normal, distance): left, right, bottom, top, near, far
+struct frustum {
+	vec4 planes[6];
+};
+
+// Draws kept and skipped by the culling pass of one kind of view since the last reset
+struct cullStats {
+	GLuint visible = 0;
+	GLuint culled = 0;
+};
+
+// Where a box lies against a frustum
+enum class containment { outside, partial, inside };
+
+frustum viewFrustum(const mat4& viewProjection);
+aabb transformBounds(const mat4&, const aabb&);	// Box around the transformed box
+bool inFrustum(const frustum&, const aabb&);
+containment classify(const frustum&, const aabb&);	// Also tells boxes wholly inside apart
\ No newline at end of file
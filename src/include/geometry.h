@@ -1,5 +1,39 @@
 #pragma once
+#include <vector>
 #include <GL/freeglut.h>
+#include "culling.h"
 
-void cube(const GLdouble* colors);
-extern GLdouble CUBE_WHITE[];
\ No newline at end of file
+// Interleaved vertex layout, matches GL_T2F_N3F_V3F
+struct vertex {
+	GLfloat s, t;
+	GLfloat nx, ny, nz;
+	GLfloat x, y, z;
+};
+
+// Geometry uploaded once to GPU-resident buffers
+struct meshBuffer {
+	GLuint vbo = 0;
+	GLuint ibo = 0;
+	GLsizei count = 0;	// Indices
+	GLsizei vertices = 0;	// Distinct vertices in the buffer
+	GLenum mode = GL_TRIANGLES;
+};
+
+void uploadMesh(meshBuffer*, const std::vector<vertex>&, const std::vector<GLuint>&, GLenum mode);
+void freeMesh(meshBuffer*);
+void drawMesh(const meshBuffer*, GLsizei instances);	// Instance arrays are set up by the caller
+
+// Projection terms the levels of detail depend on, taken once per view
+struct lodView {
+	GLdouble pixels;	// Projection y scale times half the viewport height
+	bool perspective;
+};
+lodView lodFor(const GLfloat* projection, GLint viewportHeight);
+
+// Shapes pick the mesh an instance is drawn with, from its modelview in the current view
+const meshBuffer* cube(const lodView&, const GLfloat* modelview);
+const meshBuffer* cylinder(const lodView&, const GLfloat* modelview);
+extern const aabb cubeBounds, cylinderBounds;	// Model space extents of the shapes
+const meshBuffer* cylinderMesh(GLint slices, GLint stacks);
+GLdouble projectedSize(const lodView&, const GLfloat* modelview, GLdouble radius);
+extern GLfloat CUBE_WHITE[];
\ No newline at end of file
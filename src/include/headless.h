@@ -0,0 +1,5 @@
+#pragma once
+
+// Offscreen rendering through an EGL surfaceless context, no display required
+bool initHeadless(int width, int height);
+bool dumpFrame(const char* dir, int frame);
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+#include <vector>
+#include <GL/freeglut.h>
+#include "materials.h"
+#include "bvh.h"
+#include "geometry.h"
+
+// Also the layout of the per-instance vertex attributes
+struct instance {
+	GLfloat transform[16];
+	GLfloat normal[9];	// Inverse transpose of the transform, for the shaders
+	GLfloat color[4];
+};
+
+// How a batch takes part in the cached shadow maps
+enum class shadowCaster { none, still, moving };
+
+// Repeated parts sharing one shape, material and texture
+struct instanceBatch {
+	const meshBuffer* (*shape)(const lodView&, const GLfloat* modelview);
+	materials material;
+	GLboolean lighting = true;
+	GLboolean blend = false;
+	const atlasRegion* texture = nullptr;
+	GLboolean insets = true;	// Also drawn in the inset views
+	shadowCaster shadow = shadowCaster::still;
+	const aabb* bounds = nullptr;	// Model space extents, never culled without
+};
+
+void clearInstances();
+void addInstance(const instanceBatch*, const mat4& transform, const GLfloat* color);
+void addInstance(const instanceBatch*, const GLfloat* transform, const GLfloat* normal, const GLfloat* color,
+				 const aabb* box, GLint key);	// World space box, nullptr is never culled. Key into the culling index or -1.
+void setCullingIndex(std::vector<const bvh*> trees, GLuint keys);	// Queried once per view for the keyed instances
+void sortInstances();
+void drawInstances(GLboolean main);	// One instanced draw per batch and mesh, skipping the instances outside the view
+cullStats cullStatistics(GLboolean main);	// Main view or all insets, last frame
+void markCasters(shadowCaster);	// A caster of this kind moved, appeared or disappeared
+bool castersChanged(shadowCaster);	// Since the last clearCasterChanges()
+void clearCasterChanges();
+void drawCasters(shadowCaster, const GLfloat* view, const lodView&);	// Depth only, against a light view
\ No newline at end of file
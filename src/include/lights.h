@@ -0,0 +1,17 @@
+#pragma once
+#include <vector>
+#include <GL/freeglut.h>
+#include "shaders.h"
+
+// Light list of the last main view: total lights and the per-cluster load
+struct lightStats {
+	GLint lights = 0;
+	GLboolean clustered = false;
+	GLfloat average = 0;	// Over clusters with at least one light
+	GLint max = 0;
+};
+
+void initLights();
+void updateLights(const GLfloat* ambient, const std::vector<shaderLight>&);	// Only when they change
+void assignLights(const GLfloat* view, const GLfloat* projection, GLboolean main);	// Per view
+lightStats lightStatistics();
\ No newline at end of file
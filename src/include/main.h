@@ -1,15 +1,28 @@
 #include "palette.h"
 #include "geometry.h"
 #include "objects.h"
+#include "scene.h"
+#include "transforms.h"
+#include "vecmath.h"
 #include "textures.h"
 #include "materials.h"
+#include "instancing.h"
+#include "shaders.h"
+#include "lights.h"
+#include "shadows.h"
+#include "headless.h"
+#include "profiler.h"
+#include "pacer.h"
+#include "simulation.h"
+#include "random.h"
 
 void init();
 void draw();
 void keyboard(unsigned char, int, int);
 void special(int, int, int);
 void timer(int);
-void eqTimer(int);
 void mouse(int, int);
-void wheel(int, int, int, int);
-void reshape(int, int);
\ No newline at end of file
+void mouseButton(int, int, int, int);
+void reshape(int, int);
+int renderHeadless(int frames, const char* out);
+int runBenchmark();
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include <GL/freeglut.h>
+#include "textures.h"
+#include "shaders.h"
 
 enum class materials
 {
@@ -10,5 +12,18 @@ enum class materials
     silver,
     glass
 };
+constexpr auto materialCount = 6;
 
-void initMaterial(materials);
\ No newline at end of file
+// GL state changes issued and skipped as redundant since the last reset
+struct stateCounters {
+	GLuint issued = 0;
+	GLuint skipped = 0;
+};
+extern stateCounters stateChanges;
+
+void materialTable(shaderMaterial*);	// materialCount entries, indexed by materials
+void initMaterial(materials);
+void bindTexture(GLuint);	// 0 disables texturing
+void bindRegion(const atlasRegion*);	// Atlas with this region, nullptr disables texturing
+void setEnabled(GLenum, GLboolean);
+void invalidateState();
\ No newline at end of file
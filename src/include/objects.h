@@ -1,31 +1,24 @@
 #pragma once
 #include "palette.h"
 #include <GL/freeglut.h>
+#include "culling.h"
+#include "geometry.h"
+
+constexpr auto channels = 4;
 
 typedef struct {
-	GLdouble knob1;
-	GLdouble knob2;
-	GLdouble knob3;
-	GLdouble knob4;
-	GLdouble button1;
-	GLdouble button2;
-	GLdouble button3;
-	GLdouble button4;
+	GLdouble knob[channels];
+	GLdouble button[channels];
 	GLdouble slider;
-	GLboolean pressed1;
-	GLboolean pressed2;
-	GLboolean pressed3;
-	GLboolean pressed4;
+	GLboolean pressed[channels];
 } mixerSettings;
 
 typedef struct {
-	GLdouble bar1;
-	GLdouble bar2;
-	GLdouble bar3;
-	GLdouble bar4;
+	GLdouble bar[channels];
 } bars;
 
-//void equalizer(const bars*);
-void mixer(const mixerSettings*, const bars*);
-void table();
-void floor(bool enableMesh, GLint meshCount);
\ No newline at end of file
+// Scene node shapes besides cube() and cylinder()
+const meshBuffer* sliderLine(const lodView&, const GLfloat* modelview);
+const meshBuffer* floorMesh(const lodView&, const GLfloat* modelview);	// Grid at the resolution set by floorResolution()
+void floorResolution(bool enableMesh, GLint meshCount);
+extern const aabb lineBounds, floorBounds;
\ No newline at end of file
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstddef>
+
+// Interactive frame pacing: a frame is only drawn when watched state changed, something
+// was marked dirty or an animation is running, and no faster than the frames cost to draw
+struct pacerStats {
+	unsigned drawn = 0;		// Frames requested
+	unsigned idle = 0;		// Ticks with nothing to draw
+	unsigned deferred = 0;	// Ticks that had a change but waited for the frame budget
+	double tick = 0;		// Current tick interval in ms
+};
+
+void watchState(const void* data, size_t size);	// State a frame depends on
+void markDirty();	// Changes the watched state does not cover
+bool frameDue(double frameMs);	// Snapshots the watched state when it returns true
+int nextTick(bool animating);	// Delay until the next tick in ms
+pacerStats pacerStatistics();
\ No newline at end of file
@@ -0,0 +1,44 @@
+#pragma once
+#include <GL/freeglut.h>
+
+// Frame stages timed by the profiler, in draw order
+enum class stage {
+	clear,
+	overlay,
+	lighting,
+	scene,
+	sort,
+	shadows,
+	mainView,
+	insets,
+	swap,
+	count
+};
+
+// Rolling statistics in milliseconds
+struct timingStats {
+	double min = 0;
+	double avg = 0;
+	double p50 = 0;
+	double p99 = 0;
+	double max = 0;
+};
+
+void beginFrame();
+void markStage(stage);	// Ends the previous stage and starts this one
+void endFrame();
+void countVertices(GLuint vertices);	// Vertices submitted, charged to the stage that recorded them
+stage currentStage();	// stage::count before the first mark of a frame
+void chargeVertices(stage);	// Replays charge their vertices to the recording stage, until the next mark
+
+const char* stageName(stage);
+bool gpuTimers();
+timingStats cpuStats(stage);
+timingStats gpuStats(stage);
+timingStats frameStats();
+timingStats intervalStats();	// Time between frame starts, idle time included
+double verticesPerFrame(stage);
+void resetStats();
+
+bool openProfile(const char* csvFile);
+void closeProfile();
\ No newline at end of file
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// xoshiro256** generator: seeded, reproducible and a few cycles per number, unlike
+// std::random_device which is a system call per sample
+struct randomState {
+	uint64_t s[4];
+};
+
+void seedRandom(randomState*, uint64_t seed);
+uint64_t nextRandom(randomState*);
+void fillUniform(randomState*, double* out, int count, double min, double max);	// [min, max)
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstdint>
+#include <GL/freeglut.h>
+#include "objects.h"
+#include "vecmath.h"
+
+// Shapes a scene node can draw
+enum class sceneMesh : uint8_t { none, cube, cylinder, line, floor };
+
+// Interactive values driving a node: knobs add to its rotation, buttons and the slider
+// to its y and z translation, EQ bars scale its z and hide it while their button is up
+enum class sceneBinding : uint8_t { none, knob, button, slider, eq };
+
+// Draw state of the nodes with a mesh, nodes sharing all of it share one instance batch
+struct sceneBatch {
+	sceneMesh mesh;
+	uint8_t material;	// materials
+	uint8_t texture;	// 0 for none, then wood, metal, floor
+	uint8_t shadow;	// shadowCaster
+	uint8_t lighting, blend, insets, padding;
+};
+
+// Flat struct-of-arrays node tables, parents always come before their children.
+// A node's local transform is translate * rotate * scale.
+struct sceneNodes {
+	uint32_t count = 0;
+	const int32_t* parent = nullptr;	// -1 for roots
+	const int32_t* batch = nullptr;	// -1 for groups without a mesh
+	const sceneBinding* binding = nullptr;
+	const uint8_t* channel = nullptr;	// Which knob, button or EQ bar
+	const GLfloat* translate = nullptr;	// 3 per node
+	const GLfloat* rotate = nullptr;	// Degrees and axis, 4 per node
+	const GLfloat* scale = nullptr;	// 3 per node
+	const GLfloat* color = nullptr;	// 4 per node
+};
+
+extern sceneNodes sceneTables;
+
+// Text source, through a binary cache written next to it (<source>.bin)
+bool loadScene(const char* source);
+void recordNodes(const mixerSettings*, const bars*);	// Adds every visible mesh to the draw list, in model space
+int32_t pickNode(vec3 origin, vec3 direction);	// Nearest visible mesh whose world box the ray enters, or -1
\ No newline at end of file
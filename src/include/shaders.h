@@ -0,0 +1,59 @@
+#pragma once
+#include <GL/freeglut.h>
+
+// Lights held by the uniform block, larger sets go through the clustered program
+constexpr auto maxLights = 8;
+
+// View-frustum cluster grid: screen tiles by depth slices
+constexpr auto clusterX = 16, clusterY = 9, clusterZ = 24;
+
+// Per-instance vertex attributes, clear of the locations NVIDIA aliases to gl_Vertex (0),
+// gl_Normal (2), gl_Color (3) and gl_MultiTexCoord0 (8). Matrices take one location per column.
+enum instanceAttribute : GLuint { modelAttribute = 4, normalAttribute = 9, colorAttribute = 12 };
+
+// Texture units used by the scene program
+enum textureUnit : GLint { atlasUnit, lightUnit, clusterUnit, indexUnit, spotShadowUnit, pointShadowUnit };
+
+// std140 mirror of one GLSL light source, positions and directions in world space
+struct shaderLight {
+	GLfloat position[4];	// w = 0 for directional lights
+	GLfloat ambient[4];
+	GLfloat diffuse[4];
+	GLfloat specular[4];
+	GLfloat spot[4];		// Unit direction, w = cos(cutoff) or -1 without a cone
+	GLfloat params[4];		// Spot exponent in x, range in y (0 for unbounded), shadowSource in z
+};
+
+// Shadow map sampled for a light, in shaderLight::params[2]
+enum shadowSource : GLint { noShadowMap, spotShadowMap, pointShadowMap };
+
+// Shadow map filtering, each one is a separate program variant
+enum shadowFilter : GLint { noShadows, singleTapShadows, pcfShadows };
+
+// std140 mirror of the lights uniform block
+struct lightBlock {
+	GLfloat ambient[4];		// Global ambient
+	GLint count;
+	GLint shadows;			// shadowFilter
+	GLint padding[2];
+	GLfloat spotShadow[16];	// World to spot shadow map coordinates
+	GLfloat shadowPlanes[4];	// Point map near and far planes in x and y
+	shaderLight light[maxLights];
+};
+
+// std140 mirror of one material table entry
+struct shaderMaterial {
+	GLfloat ambient[4];
+	GLfloat diffuse[4];		// Alpha is the fragment alpha
+	GLfloat specular[4];	// Shininess in w
+};
+
+// Per-pixel Blinn-Phong program replacing fixed-function lighting
+bool initShaders(const shaderMaterial* table, int count);
+void useShaders(bool);
+void useCasterShader(bool);	// Depth only, for the shadow maps
+void setLights(const lightBlock&, bool clustered);	// Uploads the lights uniform buffer
+void setClusterView(const GLfloat* viewport, const GLfloat* depth);	// Applied by the next useShaders(true)
+void setShading(GLboolean lighting, GLboolean textured);
+void setMaterial(GLint);
+void setEye(const GLfloat* eye);	// Viewer position (w = 1) or direction (w = 0)
\ No newline at end of file
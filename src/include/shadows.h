@@ -0,0 +1,23 @@
+#pragma once
+#include <GL/freeglut.h>
+#include "shaders.h"
+
+// Shadow maps: a perspective map for the spot light, a cube map for the point light
+struct shadowSettings {
+	bool enabled = true;
+	bool pcf = true;	// Percentage-closer filtering over four bilinear compares, single tap otherwise
+};
+
+// Cached map redraws since startup, for the stats overlay
+struct shadowCounters {
+	GLuint still = 0;
+	GLuint moving = 0;
+};
+
+extern shadowSettings shadowOptions;
+
+void initShadows();
+void placeShadows(const GLfloat* spot, const GLfloat* direction, GLfloat cutoff, const GLfloat* point);	// nullptr for no map
+void shadowUniforms(lightBlock*);
+void renderShadows();	// Redraws the maps whose casters changed
+shadowCounters shadowStatistics();
\ No newline at end of file
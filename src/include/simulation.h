@@ -0,0 +1,9 @@
+#pragma once
+
+// Fixed-step simulation clock: elapsed time goes in, whole steps come out, and the
+// remainder is how far drawing interpolates between the last two steps
+constexpr double simulationStep = 1.0 / 60;	// Seconds per step
+
+int advanceClock(double seconds, int maxSteps);	// Steps to run for this much elapsed time, time past maxSteps is dropped
+double stepFraction();	// Interpolation factor in [0, 1) for the next frame
+double simulationTime();	// Simulated seconds so far
\ No newline at end of file
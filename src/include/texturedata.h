@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <GL/freeglut.h>
+#include "RgbImage.h"
+
+// One mip level inside textureData::pixels
+struct mipLevel {
+	GLsizei width, height;
+	size_t offset, size;
+};
+
+// Upload-ready texture: every mip level packed back to back, RGB rows 4-byte aligned
+struct textureData {
+	GLenum format = GL_RGB;	// GL_RGB or GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	std::vector<mipLevel> levels;
+	std::vector<unsigned char> pixels;	// Built in memory...
+	const unsigned char* mapped = nullptr;	// ...or mapped from the cache file
+	void* mapping = nullptr;
+	size_t mappingSize = 0;
+};
+
+void buildTextureData(const RgbImage&, bool compress, textureData*);
+void freeTextureData(textureData*);
+const unsigned char* texturePixels(const textureData&);
+
+// Binary cache written next to the source (<source>.tex), invalidated by its mtime and size
+bool loadTextureCache(const char* source, GLenum format, textureData*);
+void saveTextureCache(const char* source, const textureData&);
+bool sourceStamp(const char* source, int64_t* time, int64_t* size);	// Modification time and size
+
+// Placement of one source inside an atlas, in texels
+struct atlasRect {
+	GLsizei x, y, width, height;
+};
+
+// Shelf packer for mismatched sizes: tallest first, each source in a cell with
+// `padding` texels of border on every side, cells aligned to `padding`
+std::vector<atlasRect> packAtlas(const std::vector<atlasRect>& sizes, GLsizei padding, GLsizei* width, GLsizei* height);
+
+// Copies every source's mip chain into its atlas cell, edges replicated into the border.
+// Stops at the first level where the cells no longer fall on texel (or DXT block) bounds.
+void buildAtlas(const std::vector<const textureData*>& sources, const std::vector<atlasRect>& rects,
+				GLsizei padding, GLsizei width, GLsizei height, textureData* atlas);
+
+// Packed atlas cache at `path`, holding each source's cell as well. Invalidated by any
+// source's mtime or size, its appearing or disappearing, or by a new padding, so a hit
+// needs none of the sources decoded.
+bool loadAtlasCache(const char* path, const std::vector<const char*>& sources, GLsizei padding, GLenum format,
+					textureData*, std::vector<atlasRect>*);
+void saveAtlasCache(const char* path, const std::vector<const char*>& sources, GLsizei padding, const textureData&,
+					const std::vector<atlasRect>&);
\ No newline at end of file
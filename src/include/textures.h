@@ -1,6 +1,17 @@
 #pragma once
 #include <GL/freeglut.h>
 
-extern GLuint wood, metal, skyBoxTex, flooring;
+// Sub-rectangle of the shared texture atlas, applied as a texture matrix scale and offset
+struct atlasRegion {
+	GLfloat scale[2] = { 1, 1 };
+	GLfloat offset[2] = { 0, 0 };
+};
 
-void initTextures();
\ No newline at end of file
+extern GLuint atlas;
+extern atlasRegion wood, metal, skyBoxTex, flooring;
+extern bool compressTextures;	// DXT1 when GL_EXT_texture_compression_s3tc is available
+
+bool hasExtension(const char* name);	// Advertised by the current context
+void initTextures();
+bool pollTextures();
+void finishTextures();
\ No newline at end of file
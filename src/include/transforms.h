@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <GL/freeglut.h>
+
+// Flat transform hierarchy: one local translate * rotate * scale per node in contiguous
+// arrays, parents before children. World matrices are cached and only rebuilt for nodes
+// whose local transform changed, or whose parent's world did.
+struct transformStats {
+	GLuint nodes = 0;
+	GLuint updated = 0;	// World matrices rebuilt by the last update
+};
+
+void resetTransforms(const int32_t* parent, uint32_t count);	// -1 parents are roots
+void setLocal(uint32_t node, const GLfloat* translate, const GLfloat* rotate, const GLfloat* scale);	// Rotate is degrees and axis
+void updateTransforms();
+const GLfloat* worldMatrix(uint32_t node);	// Column-major, ready for the draw list
+const GLfloat* worldNormal(uint32_t node);	// 3x3 normal matrix of the world matrix
+bool worldRebuilt(uint32_t node);	// By the last update, for caches derived from the world matrix
+transformStats transformStatistics();
+
+void normalMatrix(const GLfloat* m, GLfloat* normal);	// Inverse transpose of the upper 3x3, up to scale
\ No newline at end of file
@@ -0,0 +1,292 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define VECMATH_SSE 1
+#endif
+
+// Float vector math for the camera, transform hierarchy and culling. Matrices are
+// column-major like OpenGL's, so mat4::m goes straight to glLoadMatrixf.
+struct vec3 {
+	float x, y, z;
+};
+
+struct alignas(16) vec4 {
+	float x, y, z, w;
+};
+
+struct alignas(16) quat {
+	float x, y, z, w;	// Unit length for rotations
+};
+
+struct alignas(16) mat4 {
+	float m[16];
+};
+
+inline vec3 operator+(vec3 a, vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+inline vec3 operator-(vec3 a, vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+inline vec3 operator-(vec3 a) { return { -a.x, -a.y, -a.z }; }
+inline vec3 operator*(vec3 a, float s) { return { a.x * s, a.y * s, a.z * s }; }
+inline float dot(vec3 a, vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline vec3 cross(vec3 a, vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+inline float length(vec3 a) { return sqrtf(dot(a, a)); }
+
+inline vec3 normalize(vec3 a) {
+	const float l = length(a);
+	return l > 0 ? a * (1 / l) : a;
+}
+
+inline float dot(vec4 a, vec4 b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+inline mat4 toMat4(const float* m) {
+	mat4 r;
+	memcpy(r.m, m, sizeof r.m);
+	return r;
+}
+
+inline mat4 identity() {
+	return { { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } };
+}
+
+// Reference implementations, also the fallback without SSE
+namespace scalar {
+	inline mat4 multiply(const mat4& a, const mat4& b) {
+		mat4 r;
+		for (int column = 0; column < 4; column++)
+			for (int row = 0; row < 4; row++)
+				r.m[4 * column + row] = a.m[row] * b.m[4 * column] + a.m[4 + row] * b.m[4 * column + 1]
+					+ a.m[8 + row] * b.m[4 * column + 2] + a.m[12 + row] * b.m[4 * column + 3];
+		return r;
+	}
+
+	// Cofactor expansion, a singular matrix gives back zeros
+	inline mat4 inverse(const mat4& a) {
+		const float* m = a.m;
+		mat4 r;
+		float* i = r.m;
+		i[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+		i[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+		i[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+		i[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+		i[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+		i[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+		i[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+		i[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+		i[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+		i[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+		i[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+		i[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+		i[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+		i[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+		i[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+		i[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+		const float det = m[0] * i[0] + m[1] * i[4] + m[2] * i[8] + m[3] * i[12];
+		const float scale = det != 0 ? 1 / det : 0;
+		for (float& v : r.m) v *= scale;
+		return r;
+	}
+
+	inline vec4 transform(const mat4& a, vec4 v) {
+		const float* m = a.m;
+		return {
+			m[0] * v.x + m[4] * v.y + m[8] * v.z + m[12] * v.w,
+			m[1] * v.x + m[5] * v.y + m[9] * v.z + m[13] * v.w,
+			m[2] * v.x + m[6] * v.y + m[10] * v.z + m[14] * v.w,
+			m[3] * v.x + m[7] * v.y + m[11] * v.z + m[15] * v.w
+		};
+	}
+
+	inline void transformPoints(const mat4& a, const vec3* points, vec4* out, size_t count) {
+		for (size_t i = 0; i < count; i++) out[i] = transform(a, { points[i].x, points[i].y, points[i].z, 1 });
+	}
+}
+
+#ifdef VECMATH_SSE
+#define VECMATH_SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, (x) | (y) << 2 | (z) << 4 | (w) << 6)
+#define VECMATH_SPLAT(a, i) VECMATH_SHUFFLE(a, a, i, i, i, i)
+
+// Columns of a times the four components of v
+inline __m128 combineColumns(const __m128* c, __m128 v) {
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], VECMATH_SPLAT(v, 0)), _mm_mul_ps(c[1], VECMATH_SPLAT(v, 1))),
+					  _mm_add_ps(_mm_mul_ps(c[2], VECMATH_SPLAT(v, 2)), _mm_mul_ps(c[3], VECMATH_SPLAT(v, 3))));
+}
+
+// 2x2 blocks packed as (a b c d) for | a b |
+//                                    | c d |
+inline __m128 block2Mul(__m128 a, __m128 b) {
+	return _mm_add_ps(_mm_mul_ps(a, VECMATH_SHUFFLE(b, b, 0, 3, 0, 3)),
+					  _mm_mul_ps(VECMATH_SHUFFLE(a, a, 1, 0, 3, 2), VECMATH_SHUFFLE(b, b, 2, 1, 2, 1)));
+}
+
+inline __m128 block2AdjMul(__m128 a, __m128 b) {	// adj(a) * b
+	return _mm_sub_ps(_mm_mul_ps(VECMATH_SHUFFLE(a, a, 3, 3, 0, 0), b),
+					  _mm_mul_ps(VECMATH_SHUFFLE(a, a, 1, 1, 2, 2), VECMATH_SHUFFLE(b, b, 2, 3, 0, 1)));
+}
+
+inline __m128 block2MulAdj(__m128 a, __m128 b) {	// a * adj(b)
+	return _mm_sub_ps(_mm_mul_ps(a, VECMATH_SHUFFLE(b, b, 3, 0, 3, 0)),
+					  _mm_mul_ps(VECMATH_SHUFFLE(a, a, 1, 0, 3, 2), VECMATH_SHUFFLE(b, b, 2, 1, 2, 1)));
+}
+#endif
+
+inline mat4 operator*(const mat4& a, const mat4& b) {
+#ifdef VECMATH_SSE
+	const __m128 columns[4] = { _mm_load_ps(a.m), _mm_load_ps(a.m + 4), _mm_load_ps(a.m + 8), _mm_load_ps(a.m + 12) };
+	mat4 r;
+	for (int i = 0; i < 4; i++) {
+		const float* v = b.m + 4 * i;
+		_mm_store_ps(r.m + 4 * i, _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(columns[0], _mm_load1_ps(v)), _mm_mul_ps(columns[1], _mm_load1_ps(v + 1))),
+			_mm_add_ps(_mm_mul_ps(columns[2], _mm_load1_ps(v + 2)), _mm_mul_ps(columns[3], _mm_load1_ps(v + 3)))));
+	}
+	return r;
+#else
+	return scalar::multiply(a, b);
+#endif
+}
+
+inline vec4 operator*(const mat4& a, vec4 v) {
+#ifdef VECMATH_SSE
+	const __m128 columns[4] = { _mm_load_ps(a.m), _mm_load_ps(a.m + 4), _mm_load_ps(a.m + 8), _mm_load_ps(a.m + 12) };
+	vec4 r;
+	_mm_store_ps(&r.x, combineColumns(columns, _mm_load_ps(&v.x)));
+	return r;
+#else
+	return scalar::transform(a, v);
+#endif
+}
+
+// Block inverse over 2x2 sub-matrices. Inverting the transpose gives the transposed
+// inverse, so the row-major formulation works on column-major storage unchanged.
+inline mat4 inverse(const mat4& a) {
+#ifdef VECMATH_SSE
+	const __m128 c0 = _mm_load_ps(a.m), c1 = _mm_load_ps(a.m + 4), c2 = _mm_load_ps(a.m + 8), c3 = _mm_load_ps(a.m + 12);
+	const __m128 A = _mm_movelh_ps(c0, c1), B = _mm_movehl_ps(c1, c0);
+	const __m128 C = _mm_movelh_ps(c2, c3), D = _mm_movehl_ps(c3, c2);
+
+	// Determinants of A, B, C and D
+	const __m128 dets = _mm_sub_ps(
+		_mm_mul_ps(VECMATH_SHUFFLE(c0, c2, 0, 2, 0, 2), VECMATH_SHUFFLE(c1, c3, 1, 3, 1, 3)),
+		_mm_mul_ps(VECMATH_SHUFFLE(c0, c2, 1, 3, 1, 3), VECMATH_SHUFFLE(c1, c3, 0, 2, 0, 2)));
+	const __m128 detA = VECMATH_SPLAT(dets, 0), detB = VECMATH_SPLAT(dets, 1);
+	const __m128 detC = VECMATH_SPLAT(dets, 2), detD = VECMATH_SPLAT(dets, 3);
+
+	const __m128 DC = block2AdjMul(D, C), AB = block2AdjMul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), block2Mul(B, DC));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), block2Mul(C, AB));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), block2MulAdj(D, AB));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), block2MulAdj(A, DC));
+
+	// |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+	__m128 trace = _mm_mul_ps(AB, VECMATH_SHUFFLE(DC, DC, 0, 2, 1, 3));
+	trace = _mm_add_ps(trace, _mm_movehl_ps(trace, trace));
+	trace = _mm_add_ss(trace, VECMATH_SPLAT(trace, 1));
+	const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), VECMATH_SPLAT(trace, 0));
+	if (_mm_cvtss_f32(det) == 0) return mat4();
+
+	const __m128 scale = _mm_div_ps(_mm_setr_ps(1, -1, -1, 1), det);
+	X = _mm_mul_ps(X, scale);
+	Y = _mm_mul_ps(Y, scale);
+	Z = _mm_mul_ps(Z, scale);
+	W = _mm_mul_ps(W, scale);
+
+	mat4 r;
+	_mm_store_ps(r.m, VECMATH_SHUFFLE(X, Y, 3, 1, 3, 1));
+	_mm_store_ps(r.m + 4, VECMATH_SHUFFLE(X, Y, 2, 0, 2, 0));
+	_mm_store_ps(r.m + 8, VECMATH_SHUFFLE(Z, W, 3, 1, 3, 1));
+	_mm_store_ps(r.m + 12, VECMATH_SHUFFLE(Z, W, 2, 0, 2, 0));
+	return r;
+#else
+	return scalar::inverse(a);
+#endif
+}
+
+// Points with w = 1, no perspective divide
+inline void transformPoints(const mat4& a, const vec3* points, vec4* out, size_t count) {
+#ifdef VECMATH_SSE
+	const __m128 c0 = _mm_load_ps(a.m), c1 = _mm_load_ps(a.m + 4), c2 = _mm_load_ps(a.m + 8), c3 = _mm_load_ps(a.m + 12);
+	for (size_t i = 0; i < count; i++) {
+		const __m128 xy = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(points[i].x)), _mm_mul_ps(c1, _mm_set1_ps(points[i].y)));
+		_mm_store_ps(&out[i].x, _mm_add_ps(xy, _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(points[i].z)), c3)));
+	}
+#else
+	scalar::transformPoints(a, points, out, count);
+#endif
+}
+
+inline vec3 transformPoint(const mat4& a, vec3 p) {
+	const vec4 r = a * vec4{ p.x, p.y, p.z, 1 };
+	return { r.x, r.y, r.z };
+}
+
+inline quat axisAngle(float degrees, vec3 axis) {
+	const vec3 n = normalize(axis);
+	const float half = degrees * (float)M_PI / 360, s = sinf(half);
+	return { n.x * s, n.y * s, n.z * s, cosf(half) };
+}
+
+inline quat operator*(quat a, quat b) {
+	return {
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+	};
+}
+
+inline vec3 rotate(quat q, vec3 v) {
+	const vec3 u = { q.x, q.y, q.z };
+	const vec3 t = cross(u, v) * 2;
+	return v + t * q.w + cross(u, t);
+}
+
+// Normalised lerp, taking the short way round
+inline quat nlerp(quat a, quat b, float t) {
+	const float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1 : 1;
+	quat r = { a.x + (sign * b.x - a.x) * t, a.y + (sign * b.y - a.y) * t, a.z + (sign * b.z - a.z) * t, a.w + (sign * b.w - a.w) * t };
+	const float l = sqrtf(r.x * r.x + r.y * r.y + r.z * r.z + r.w * r.w);
+	return { r.x / l, r.y / l, r.z / l, r.w / l };
+}
+
+// translate * rotate * scale in one go
+inline mat4 compose(vec3 t, quat q, vec3 s) {
+	const float x = q.x, y = q.y, z = q.z, w = q.w;
+	return { {
+		(1 - 2 * (y * y + z * z)) * s.x, 2 * (x * y + z * w) * s.x, 2 * (x * z - y * w) * s.x, 0,
+		2 * (x * y - z * w) * s.y, (1 - 2 * (x * x + z * z)) * s.y, 2 * (y * z + x * w) * s.y, 0,
+		2 * (x * z + y * w) * s.z, 2 * (y * z - x * w) * s.z, (1 - 2 * (x * x + y * y)) * s.z, 0,
+		t.x, t.y, t.z, 1
+	} };
+}
+
+// Same matrices as gluPerspective, glOrtho and gluLookAt
+inline mat4 perspective(float fovDegrees, float aspect, float near, float far) {
+	const float f = 1 / tanf(fovDegrees * (float)M_PI / 360);
+	return { {
+		f / aspect, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, (far + near) / (near - far), -1,
+		0, 0, 2 * far * near / (near - far), 0
+	} };
+}
+
+inline mat4 ortho(float left, float right, float bottom, float top, float near, float far) {
+	return { {
+		2 / (right - left), 0, 0, 0,
+		0, 2 / (top - bottom), 0, 0,
+		0, 0, -2 / (far - near), 0,
+		-(right + left) / (right - left), -(top + bottom) / (top - bottom), -(far + near) / (far - near), 1
+	} };
+}
+
+inline mat4 lookAt(vec3 eye, vec3 center, vec3 up) {
+	const vec3 f = normalize(center - eye), s = normalize(cross(f, up)), u = cross(s, f);
+	return { {
+		s.x, u.x, -f.x, 0,
+		s.y, u.y, -f.y, 0,
+		s.z, u.z, -f.z, 0,
+		-dot(s, eye), -dot(u, eye), dot(f, eye), 1
+	} };
+}
\ No newline at end of file
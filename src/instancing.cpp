@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <tuple>
+
+#include "include/instancing.h"
+#include "include/palette.h"
+#include "include/lights.h"
+#include "include/shaders.h"
+#include "include/transforms.h"
+#include "include/profiler.h"
+
+struct drawItem {
+	instance i;
+	const instanceBatch* batch;
+	aabb box;
+	bool bounded;
+	GLint key;
+	stage recorded;	// Profiler stage its vertices are charged to
+};
+
+std::vector<drawItem> drawList;
+cullStats mainCulling, insetCulling;
+bool casterChanges[3];	// By shadowCaster, set by the recorders
+
+// Spatial index over the keyed instances' boxes, and which keys the current view sees
+std::vector<const bvh*> cullingIndex;
+std::vector<uint32_t> keysInView;
+std::vector<GLboolean> inView;
+
+// One instanced draw: a run of records in the instance buffer sharing a batch and a mesh
+struct instancedDraw {
+	const instanceBatch* batch;	// nullptr for casters, which only need the mesh
+	const meshBuffer* mesh;
+	stage recorded;
+	GLsizei first, count;
+};
+
+// Instances of the view being drawn, grouped into draws and uploaded together
+struct {
+	std::vector<std::pair<const meshBuffer*, const drawItem*>> pending;	// Of the current batch
+	std::vector<instance> records;
+	std::vector<instancedDraw> draws;
+	GLuint buffer = 0;
+} instances;
+
+// Records an instance with a ready-made model transform and normal matrix
+void addInstance(const instanceBatch* batch, const GLfloat* transform, const GLfloat* normal, const GLfloat* color,
+				 const aabb* box, GLint key) {
+	drawItem item = { { {}, {}, { WHITE } }, batch, {}, box != nullptr, key, currentStage() };
+	if (box) item.box = *box;
+	memcpy(item.i.transform, transform, sizeof item.i.transform);
+	memcpy(item.i.normal, normal, sizeof item.i.normal);
+	if (color) memcpy(item.i.color, color, sizeof item.i.color);
+	drawList.push_back(item);
+}
+
+// Records an instance outside the transform hierarchy, its normal matrix and box are derived here
+void addInstance(const instanceBatch* batch, const mat4& transform, const GLfloat* color) {
+	GLfloat normal[9];
+	normalMatrix(transform.m, normal);
+	aabb box;
+	if (batch->bounds) box = transformBounds(transform, *batch->bounds);
+	// Nothing tracks these transforms between frames, so they always count as changed
+	if (batch->shadow != shadowCaster::none) markCasters(batch->shadow);
+	addInstance(batch, transform.m, normal, color, batch->bounds ? &box : nullptr, -1);
+}
+
+// Draw order: opaque before blended, then grouped by material, texture and batch. The
+// pointers are compared with std::less, built-in < between unrelated objects is unspecified.
+bool drawsBefore(const drawItem& a, const drawItem& b) {
+	const instanceBatch* x = a.batch;
+	const instanceBatch* y = b.batch;
+	const auto state = [](const instanceBatch* b) { return std::make_tuple(b->blend, b->lighting, b->material); };
+	if (state(x) != state(y)) return state(x) < state(y);
+	if (x->texture != y->texture) return std::less<const atlasRegion*>()(x->texture, y->texture);
+	return std::less<const instanceBatch*>()(x, y);
+}
+
+void clearInstances() {
+	drawList.clear();
+	mainCulling = insetCulling = cullStats();
+}
+
+void setCullingIndex(std::vector<const bvh*> trees, GLuint keys) {
+	cullingIndex = trees;
+	inView.resize(keys);
+}
+
+void sortInstances() {
+	std::stable_sort(drawList.begin(), drawList.end(), drawsBefore);
+}
+
+// World space viewer for specular highlights: the camera position for perspective
+// projections, the direction towards the viewer for orthographic ones
+void viewerEye(const GLfloat* view, const GLfloat* projection, GLfloat* eye) {
+	const bool ortho = projection[15] == 1;
+	for (int i = 0; i < 3; i++)
+		eye[i] = ortho ? view[4 * i + 2]
+			: -(view[4 * i] * view[12] + view[4 * i + 1] * view[13] + view[4 * i + 2] * view[14]);
+	eye[3] = ortho ? 0 : 1;
+}
+
+// Moves the pending instances into the records, one draw per mesh. Equal meshes keep
+// their recorded order, which blending relies on.
+void flushPending(const instanceBatch* batch) {
+	auto& pending = instances.pending;
+	std::stable_sort(pending.begin(), pending.end(), [](const auto& a, const auto& b) {
+		return std::less<const meshBuffer*>()(a.first, b.first)
+			|| (a.first == b.first && a.second->recorded < b.second->recorded);
+	});
+	for (const auto& p : pending) {
+		const instancedDraw* last = instances.draws.empty() ? nullptr : &instances.draws.back();
+		if (!last || last->batch != batch || last->mesh != p.first || last->recorded != p.second->recorded)
+			instances.draws.push_back({ batch, p.first, p.second->recorded, (GLsizei)instances.records.size(), 0 });
+		instances.records.push_back(p.second->i);
+		instances.draws.back().count++;
+	}
+	pending.clear();
+}
+
+// Uploads the records once for all the draws of a view, and enables the instance arrays
+void uploadInstances() {
+	if (!instances.buffer) glGenBuffers(1, &instances.buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instances.buffer);
+	glBufferData(GL_ARRAY_BUFFER, instances.records.size() * sizeof(instance), instances.records.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	for (GLuint a = 0; a < 4; a++) {
+		glEnableVertexAttribArray(modelAttribute + a);
+		glVertexAttribDivisor(modelAttribute + a, 1);
+	}
+	for (GLuint a = 0; a < 3; a++) {
+		glEnableVertexAttribArray(normalAttribute + a);
+		glVertexAttribDivisor(normalAttribute + a, 1);
+	}
+	glEnableVertexAttribArray(colorAttribute);
+	glVertexAttribDivisor(colorAttribute, 1);
+}
+
+// Points the instance arrays at one draw's records and draws them all
+void drawRecords(const instancedDraw& draw) {
+	const GLsizei stride = sizeof(instance);
+	const size_t base = draw.first * sizeof(instance);
+	glBindBuffer(GL_ARRAY_BUFFER, instances.buffer);
+	for (GLuint a = 0; a < 4; a++)
+		glVertexAttribPointer(modelAttribute + a, 4, GL_FLOAT, GL_FALSE, stride,
+							  (const void*)(base + offsetof(instance, transform) + 4 * a * sizeof(GLfloat)));
+	for (GLuint a = 0; a < 3; a++)
+		glVertexAttribPointer(normalAttribute + a, 3, GL_FLOAT, GL_FALSE, stride,
+							  (const void*)(base + offsetof(instance, normal) + 3 * a * sizeof(GLfloat)));
+	glVertexAttribPointer(colorAttribute, 4, GL_FLOAT, GL_FALSE, stride, (const void*)(base + offsetof(instance, color)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	chargeVertices(draw.recorded);
+	drawMesh(draw.mesh, draw.count);
+}
+
+void finishInstances() {
+	for (GLuint a = 0; a < 4; a++) glDisableVertexAttribArray(modelAttribute + a);
+	for (GLuint a = 0; a < 3; a++) glDisableVertexAttribArray(normalAttribute + a);
+	glDisableVertexAttribArray(colorAttribute);
+	instances.records.clear();
+	instances.draws.clear();
+}
+
+// Replays the sorted draw list against the view currently on the modelview stack. The
+// visible instances of each batch are drawn with one call per mesh they use, which is
+// one per batch except where cylinders pick different levels of detail.
+void drawInstances(GLboolean main) {
+	GLfloat view[16], projection[16], eye[4];
+	GLint viewport[4];
+	glGetFloatv(GL_MODELVIEW_MATRIX, view);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	viewerEye(view, projection, eye);
+	const lodView lod = lodFor(projection, viewport[3]);
+	assignLights(view, projection, main);
+	const frustum visible = viewFrustum(toMat4(projection) * toMat4(view));
+	cullStats& culling = main ? mainCulling : insetCulling;
+	std::fill(inView.begin(), inView.end(), false);
+	for (const bvh* tree : cullingIndex) {
+		keysInView.clear();
+		frustumQuery(*tree, visible, &keysInView);
+		for (uint32_t key : keysInView) inView[key] = true;
+	}
+
+	const mat4 viewMatrix = toMat4(view);
+	const instanceBatch* current = nullptr;
+	for (const auto& item : drawList) {
+		const instanceBatch* batch = item.batch;
+		if (!main && !batch->insets) continue;
+		const bool shown = item.key >= 0 ? inView[item.key] : !item.bounded || inFrustum(visible, item.box);
+		if (!shown) {
+			culling.culled++;
+			continue;
+		}
+		culling.visible++;
+		if (batch != current) flushPending(current);
+		current = batch;
+		instances.pending.emplace_back(batch->shape(lod, (viewMatrix * toMat4(item.i.transform)).m), &item);
+	}
+	flushPending(current);
+
+	useShaders(true);
+	setEye(eye);
+	uploadInstances();
+	for (const auto& draw : instances.draws) {
+		const instanceBatch* batch = draw.batch;
+		setEnabled(GL_BLEND, batch->blend);
+		setShading(batch->lighting, batch->texture != nullptr);
+		initMaterial(batch->material);
+		bindRegion(batch->texture);
+		drawRecords(draw);
+	}
+	finishInstances();
+
+	bindRegion(nullptr);
+	setEnabled(GL_BLEND, false);
+	useShaders(false);
+}
+
+cullStats cullStatistics(GLboolean main) {
+	return main ? mainCulling : insetCulling;
+}
+
+void markCasters(shadowCaster kind) {
+	casterChanges[(int)kind] = true;
+}
+
+bool castersChanged(shadowCaster kind) {
+	return casterChanges[(int)kind];
+}
+
+void clearCasterChanges() {
+	std::fill(std::begin(casterChanges), std::end(casterChanges), false);
+}
+
+// Casters of every batch are drawn together, one call per mesh
+void drawCasters(shadowCaster kind, const GLfloat* view, const lodView& lod) {
+	const mat4 viewMatrix = toMat4(view);
+	for (const auto& item : drawList)
+		if (item.batch->shadow == kind)
+			instances.pending.emplace_back(item.batch->shape(lod, (viewMatrix * toMat4(item.i.transform)).m), &item);
+	flushPending(nullptr);
+
+	glLoadMatrixf(view);
+	useCasterShader(true);
+	uploadInstances();
+	for (const auto& draw : instances.draws) drawRecords(draw);
+	finishInstances();
+	useCasterShader(false);
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cmath>
+
+#include "include/lights.h"
+#include "include/shadows.h"
+#include "include/vecmath.h"
+
+constexpr auto clusterCount = clusterX * clusterY * clusterZ;
+
+// Light list in world space, binned per view into the cluster grid the shader reads
+struct {
+	std::vector<shaderLight> lights;
+	bool clustered = false;
+	std::vector<std::vector<GLuint>> bins = std::vector<std::vector<GLuint>>(clusterCount);
+	std::vector<GLuint> grid;		// Offset and count per cluster
+	std::vector<GLuint> indices;
+	GLuint buffers[3];
+	GLuint textures[3];
+	lightStats stats;
+} manager;
+
+enum { lightData, clusterData, indexData };
+
+// Texture buffers stay bound to their units, only their contents change
+void initLights() {
+	const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	const GLint units[] = { lightUnit, clusterUnit, indexUnit };
+	glGenBuffers(3, manager.buffers);
+	glGenTextures(3, manager.textures);
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_TEXTURE_BUFFER, manager.buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_DYNAMIC_DRAW);
+		glActiveTexture(GL_TEXTURE0 + units[i]);
+		glBindTexture(GL_TEXTURE_BUFFER, manager.textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], manager.buffers[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void upload(GLuint buffer, const void* data, size_t size) {
+	glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(size, 16), NULL, GL_DYNAMIC_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Small sets fit the uniform block, anything above maxLights is clustered
+void updateLights(const GLfloat* ambient, const std::vector<shaderLight>& lights) {
+	lightBlock block = {};
+	for (int i = 0; i < 4; i++) block.ambient[i] = ambient[i];
+	manager.clustered = lights.size() > maxLights;
+	if (manager.clustered) {
+		manager.lights = lights;
+		upload(manager.buffers[lightData], lights.data(), lights.size() * sizeof(shaderLight));
+	} else {
+		block.count = lights.size();
+		std::copy(lights.begin(), lights.end(), block.light);
+	}
+	shadowUniforms(&block);
+	setLights(block, manager.clustered);
+
+	manager.stats = lightStats();
+	manager.stats.lights = lights.size();
+	manager.stats.clustered = manager.clustered;
+}
+
+GLint clampCell(GLfloat value, GLint cells) {
+	return std::min(std::max((GLint)floor(value), 0), cells - 1);
+}
+
+// Bins every light's bounding sphere into the tiles and depth slices it overlaps
+void assignLights(const GLfloat* view, const GLfloat* projection, GLboolean main) {
+	if (!manager.clustered) return;
+
+	// Depth slices are exponential for perspective views and linear for orthographic ones
+	const bool ortho = projection[15] == 1;
+	const GLfloat near = ortho ? (projection[14] + 1) / projection[10] : projection[14] / (projection[10] - 1);
+	const GLfloat far = ortho ? (projection[14] - 1) / projection[10] : projection[14] / (projection[10] + 1);
+	const GLfloat scale = ortho ? clusterZ / (far - near) : clusterZ / log(far / near);
+	auto slice = [&](GLfloat depth) {
+		return clampCell(ortho ? (depth - near) * scale : log(std::max(depth, near) / near) * scale, clusterZ);
+	};
+
+	const mat4 clipFrom = toMat4(projection);
+	for (auto& bin : manager.bins) bin.clear();
+	for (GLuint i = 0; i < manager.lights.size(); i++) {
+		const shaderLight& light = manager.lights[i];
+		const GLfloat range = light.params[1];
+		GLint x0 = 0, x1 = clusterX - 1, y0 = 0, y1 = clusterY - 1, z0 = 0, z1 = clusterZ - 1;
+		if (range > 0) {
+			GLfloat center[3];
+			for (int r = 0; r < 3; r++)
+				center[r] = view[r] * light.position[0] + view[4 + r] * light.position[1]
+					+ view[8 + r] * light.position[2] + view[12 + r];
+			const GLfloat depth = -center[2];
+			if (depth + range < near || depth - range > far) continue;
+			z0 = slice(depth - range);
+			z1 = slice(depth + range);
+
+			// Screen bounds of the sphere's box, the whole screen if it crosses the near plane
+			if (ortho || depth - range > near) {
+				vec3 corners[8];
+				vec4 clip[8];
+				for (int corner = 0; corner < 8; corner++)
+					corners[corner] = {
+						center[0] + (corner & 1 ? range : -range),
+						center[1] + (corner & 2 ? range : -range),
+						center[2] + (corner & 4 ? range : -range)
+					};
+				transformPoints(clipFrom, corners, clip, 8);
+				GLfloat lo[2] = { INFINITY, INFINITY }, hi[2] = { -INFINITY, -INFINITY };
+				for (const vec4& p : clip) {
+					const GLfloat ndc[2] = { p.x / p.w, p.y / p.w };
+					for (int a = 0; a < 2; a++) {
+						lo[a] = std::min(lo[a], ndc[a]);
+						hi[a] = std::max(hi[a], ndc[a]);
+					}
+				}
+				if (hi[0] < -1 || lo[0] > 1 || hi[1] < -1 || lo[1] > 1) continue;
+				x0 = clampCell((lo[0] * 0.5f + 0.5f) * clusterX, clusterX);
+				x1 = clampCell((hi[0] * 0.5f + 0.5f) * clusterX, clusterX);
+				y0 = clampCell((lo[1] * 0.5f + 0.5f) * clusterY, clusterY);
+				y1 = clampCell((hi[1] * 0.5f + 0.5f) * clusterY, clusterY);
+			}
+		}
+		for (GLint z = z0; z <= z1; z++)
+			for (GLint y = y0; y <= y1; y++)
+				for (GLint x = x0; x <= x1; x++)
+					manager.bins[(z * clusterY + y) * clusterX + x].push_back(i);
+	}
+
+	// Flattened into one index list, each cluster holding its offset and count
+	manager.grid.resize(2 * clusterCount);
+	manager.indices.clear();
+	GLint used = 0, max = 0;
+	for (int c = 0; c < clusterCount; c++) {
+		const auto& bin = manager.bins[c];
+		manager.grid[2 * c] = manager.indices.size();
+		manager.grid[2 * c + 1] = bin.size();
+		manager.indices.insert(manager.indices.end(), bin.begin(), bin.end());
+		if (!bin.empty()) used++;
+		max = std::max<GLint>(max, bin.size());
+	}
+	upload(manager.buffers[clusterData], manager.grid.data(), manager.grid.size() * sizeof(GLuint));
+	upload(manager.buffers[indexData], manager.indices.data(), manager.indices.size() * sizeof(GLuint));
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	const GLfloat area[4] = { (GLfloat)viewport[0], (GLfloat)viewport[1], (GLfloat)viewport[2], (GLfloat)viewport[3] };
+	const GLfloat depth[4] = { near, far, scale, ortho ? 1.0f : 0.0f };
+	setClusterView(area, depth);
+
+	if (main) {
+		manager.stats.average = used ? (GLfloat)manager.indices.size() / used : 0;
+		manager.stats.max = max;
+	}
+}
+
+lightStats lightStatistics() {
+	return manager.stats;
+}
\ No newline at end of file
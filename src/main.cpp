@@ -1,7 +1,12 @@
 #define _USE_MATH_DEFINES
+#include <algorithm>
+#include <climits>
 #include <cmath>
 #include <random>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <GL/freeglut.h>
 #include "include/main.h"
 
@@ -11,7 +16,55 @@ constexpr auto world = 10;
 // Window size (automatically refreshed by reshaping the window)
 int windowWidth = 800, windowHeight = 600;
 
+// Offscreen rendering without a window (--headless WxH --frames N --out dir/)
+bool headless = false;
+
+// Per-frame timing dump (--profile file.csv)
+const char* profileFile = NULL;
+
+// Scripted headless benchmark (--bench)
+bool bench = false;
+
+// Simulated seconds per real second (--speed X); headless frames are 1/60 s apart
+GLdouble simulationSpeed = 1;
+
+// EQ generator seed (--seed N); the benchmark defaults to a fixed one so runs are comparable
+randomState eqRandom;
+
+// Scene description (--scene file), compiled to <file>.bin on first load
+const char* sceneFile = "assets/mixer.scene";
+
+void watchScene();
+
 int main(int argc, char **argv) {
+	int frames = 1;
+	const char* out = ".";
+	const char* seed = NULL;
+	for (int i = 1; i < argc; i++) {
+		const bool value = i + 1 < argc;
+		if (!strcmp(argv[i], "--bench")) bench = true;
+		else if (!strcmp(argv[i], "--compress")) compressTextures = true;
+		else if (!strcmp(argv[i], "--headless")) {
+			// A batch run must not fall back to opening a window
+			headless = value && sscanf(argv[++i], "%dx%d", &windowWidth, &windowHeight) == 2
+				&& windowWidth > 0 && windowHeight > 0;
+			if (!headless) {
+				fprintf(stderr, "Usage: %s --headless WIDTHxHEIGHT [--frames N] [--out DIR]\n", argv[0]);
+				return 1;
+			}
+		}
+		else if (!strcmp(argv[i], "--frames") && value) frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--out") && value) out = argv[++i];
+		else if (!strcmp(argv[i], "--profile") && value) profileFile = argv[++i];
+		else if (!strcmp(argv[i], "--speed") && value) simulationSpeed = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && value) seed = argv[++i];
+		else if (!strcmp(argv[i], "--scene") && value) sceneFile = argv[++i];
+	}
+	if (seed) seedRandom(&eqRandom, strtoull(seed, NULL, 0));
+	else seedRandom(&eqRandom, bench ? 1 : std::random_device()());
+	if (bench) return runBenchmark();
+	if (headless) return renderHeadless(frames, out);
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
 	glutInitWindowSize(windowWidth, windowHeight);
@@ -19,14 +72,15 @@ int main(int argc, char **argv) {
 	glutCreateWindow(windowTitle);
 
 	init();
+	watchScene();
+	if (profileFile) openProfile(profileFile);
 
 	glutDisplayFunc(draw);		  // Display Callback
 	glutKeyboardFunc(keyboard);	  // Keyboard (ASCII) Callback
 	glutSpecialFunc(special);	  // Keyboard (Non-ASCII) Callback
 	glutMotionFunc(mouse);		  // Mouse Callback #1
-	glutMouseFunc(wheel);		  // Mouse Callback #2
-	glutTimerFunc(0, timer, 0);	  // Timer #1 - Redisplay
-	glutTimerFunc(0, eqTimer, 1); // Timer #2 - EQ
+	glutMouseFunc(mouseButton);	  // Mouse Callback #2
+	glutTimerFunc(0, timer, 0);	  // Timer - Animation and paced redisplay
 	glutReshapeFunc(reshape);	  // Reshape Callback
 
 	glutMainLoop();
@@ -69,9 +123,23 @@ struct camera {
 	GLdouble radius = 10;
 	GLdouble theta = 0;
 	GLdouble phi = M_PI / 3;
-	GLdouble obs[3];
 } Camera;
 
+// Camera position on its sphere around the origin
+vec3 orbitEye() {
+	const GLfloat radius = Camera.radius, theta = Camera.theta, phi = Camera.phi;
+	return { radius * sinf(theta) * sinf(phi), radius * cosf(phi), radius * cosf(theta) * sinf(phi) };
+}
+
+// Main view matrices, shared by drawing and picking
+mat4 cameraProjection() {
+	return perspective(Camera.fov, (GLfloat)windowWidth / windowHeight, 0.1, 20 * world);
+}
+
+mat4 cameraView() {
+	return lookAt(orbitEye(), { 0, 0, 0 }, { 0, 1, 0 });
+}
+
 // Interactive elements
 mixerSettings interactive;
 bars eq;
@@ -84,40 +152,46 @@ struct ambient {
 	GLfloat dark[4] = {0, 0, 0, 1};
 	void init() {
 		for (int i = 0; i < 3; i++) light[i] = intensity;
-		glLightModelfv(GL_LIGHT_MODEL_AMBIENT, light);
 	}
 } Ambient;
 
+// Set by the handlers that change a light, the uniform buffer is only rebuilt then
+bool lightsChanged = true;
+GLfloat litPhase = 0;	// Disco phase the uniform buffer was built with
+
 // OpenGL and interactive elements init
 void init() {
 	glClearColor(BLACK);
 	glEnable(GL_DEPTH_TEST);
-	glShadeModel(GL_SMOOTH);
-	glEnable(GL_NORMALIZE);
 	glEnable(GL_CULL_FACE);
 	glCullFace(GL_BACK);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// Lighting
-	glEnable(GL_LIGHTING);
+	// Scene layout, before any texture worker starts
+	if (!loadScene(sceneFile)) exit(1);
+
+	// Lighting (per pixel, in the shaders)
+	shaderMaterial table[materialCount];
+	materialTable(table);
+	if (!initShaders(table, materialCount)) exit(1);
+	initLights();
+	initShadows();
 	Ambient.init();
 
 	// Textures
 	initTextures();
 
 	interactive.slider = 0.5;
-	interactive.knob1 = angleMin;
-	interactive.knob2 = angleMin;
-	interactive.knob3 = angleMin;
-	interactive.knob4 = angleMin;
-	interactive.pressed1 = false;
-	interactive.pressed2 = false;
-	interactive.pressed3 = false;
-	interactive.pressed4 = false;
+	for (int i = 0; i < channels; i++) {
+		interactive.knob[i] = angleMin;
+		interactive.pressed[i] = false;
+	}
 }
 
 const char colours[4][6] = {"White", "Red", "Green", "Blue"};
 
 struct {
+	bool enabled = false;
 	GLfloat intensity = 1;
 	GLfloat color[3] = {1, 1, 1};
 	GLfloat ambient[3] = {0, 0, 0};
@@ -129,7 +203,7 @@ struct {
 	GLint exponent = 50;
 	short mode = 0;
 	void cycle() {
-		if (!glIsEnabled(GL_LIGHT1)) return;
+		if (!enabled) return;
 		mode = (mode + 1) % 4;
 		if (mode != 0) for (int i = 0; i < 3; i++) color[i] = 0;
 		switch (mode) {
@@ -149,6 +223,7 @@ struct {
 } SpotLight;
 
 struct {
+	bool enabled = false;
 	GLfloat intensity = 0.2;
 	GLfloat color[3] = {1, 1, 1};
 	GLfloat ambient[3] = {0, 0, 0};
@@ -158,7 +233,7 @@ struct {
 	bool discoMode = false;
 	short mode = 0;
 	void cycle() {
-		if (!glIsEnabled(GL_LIGHT0)) return;
+		if (!enabled) return;
 		mode = (mode + 1) % 4;
 		if (mode != 0) for (int i = 0; i < 3; i++) color[i] = 0;
 		switch (mode) {
@@ -177,105 +252,184 @@ struct {
 	}
 } PointLight;
 
-void lighting() {
+// discoMode swaps the point light for rings of coloured, ranged stage lights over the floor
+constexpr auto discoLights = 256, discoRings = 16;
+constexpr GLfloat discoRange = 1.5;
+GLfloat discoPhase = 0;
+
+// Fills one shader light from a colour and intensity, ambient, diffuse and specular alike
+void setSource(shaderLight* light, const GLfloat* color, GLfloat intensity, const GLfloat* position) {
+	*light = shaderLight();
 	for (int i = 0; i < 3; i++) {
-		SpotLight.ambient[i] = SpotLight.color[i] * SpotLight.intensity;
-		SpotLight.diffuse[i] = SpotLight.color[i] * SpotLight.intensity;
-		SpotLight.specular[i] = SpotLight.color[i] * SpotLight.intensity;
-		PointLight.ambient[i] = PointLight.color[i] * PointLight.intensity;
-		PointLight.diffuse[i] = PointLight.color[i] * PointLight.intensity;
-		PointLight.specular[i] = PointLight.color[i] * PointLight.intensity;
+		light->ambient[i] = color[i] * intensity;
+		light->diffuse[i] = color[i] * intensity;
+		light->specular[i] = color[i] * intensity;
 	}
+	for (int i = 0; i < 4; i++) light->position[i] = position[i];
+	light->spot[3] = -1;
+}
 
-	glLightfv(GL_LIGHT0, GL_POSITION, PointLight.position);
-	glLightfv(GL_LIGHT0, GL_AMBIENT, PointLight.ambient);
-	glLightfv(GL_LIGHT0, GL_DIFFUSE, PointLight.diffuse);
-	glLightfv(GL_LIGHT0, GL_SPECULAR, PointLight.specular);
+void discoSources(std::vector<shaderLight>* lights, GLfloat phase) {
+	constexpr auto perRing = discoLights / discoRings;
+	for (int i = 0; i < discoLights; i++) {
+		const int ring = i / perRing;
+		const GLfloat angle = 2 * M_PI * (i % perRing) / perRing + (ring % 2 ? phase : -phase);
+		const GLfloat radius = 1.5 + 0.5 * ring;
+		const GLfloat position[4] = { radius * cosf(angle), -3.5, radius * sinf(angle), 1 };
+
+		// Hue wheel around the rings
+		const GLfloat hue = fmodf(6.0f * i / perRing + ring, 6);
+		const GLfloat color[3] = {
+			std::min(std::max(fabsf(hue - 3) - 1, 0.0f), 1.0f),
+			std::min(std::max(2 - fabsf(hue - 2), 0.0f), 1.0f),
+			std::min(std::max(2 - fabsf(hue - 4), 0.0f), 1.0f)
+		};
+		lights->emplace_back();
+		setSource(&lights->back(), color, 2 * PointLight.intensity, position);
+		lights->back().params[1] = discoRange;
+	}
+}
+
+GLfloat shownPhase();
 
-	glLightfv(GL_LIGHT1, GL_POSITION, SpotLight.position);
-	glLightfv(GL_LIGHT1, GL_AMBIENT, SpotLight.ambient);
-	glLightfv(GL_LIGHT1, GL_DIFFUSE, SpotLight.diffuse);
-	glLightfv(GL_LIGHT1, GL_SPECULAR, SpotLight.specular);
-	glLightfv(GL_LIGHT1, GL_SPOT_DIRECTION, SpotLight.direction);
-	glLighti(GL_LIGHT1, GL_SPOT_EXPONENT, SpotLight.exponent);
-	glLighti(GL_LIGHT1, GL_SPOT_CUTOFF, SpotLight.cutoff);
+// Rebuilds the light list, positions are in world space so no view needs it again
+void lighting() {
+	// The disco lights move between steps too, so any new step fraction rebuilds them
+	const bool disco = PointLight.enabled && PointLight.discoMode;
+	if (disco && shownPhase() != litPhase) lightsChanged = true;
+	if (!lightsChanged) return;
+	lightsChanged = false;
+	litPhase = shownPhase();
+
+	GLfloat ambient[4] = { 0, 0, 0, 1 };
+	for (int i = 0; i < 3; i++) ambient[i] = Ambient.enabled ? Ambient.light[i] : Ambient.dark[i];
+	std::vector<shaderLight> lights;
+	if (disco) discoSources(&lights, litPhase);
+	else if (PointLight.enabled) {
+		lights.emplace_back();
+		setSource(&lights.back(), PointLight.color, PointLight.intensity, PointLight.position);
+		lights.back().params[2] = pointShadowMap;
+	}
+	if (SpotLight.enabled) {
+		lights.emplace_back();
+		shaderLight* spot = &lights.back();
+		setSource(spot, SpotLight.color, SpotLight.intensity, SpotLight.position);
+		const GLfloat* d = SpotLight.direction;
+		const GLfloat length = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+		for (int i = 0; i < 3; i++) spot->spot[i] = d[i] / length;
+		spot->spot[3] = cos(SpotLight.cutoff * M_PI / 180);
+		spot->params[0] = SpotLight.exponent;
+		spot->params[2] = spotShadowMap;
+	}
+	placeShadows(SpotLight.enabled ? SpotLight.position : nullptr, SpotLight.direction, SpotLight.cutoff,
+				 PointLight.enabled && !PointLight.discoMode ? PointLight.position : nullptr);
+	updateLights(ambient, lights);
 }
 
+// Light markers are only drawn in the main view, and would block their own shadow maps
+instanceBatch lightMarkers = { cube, materials::whitePlastic, false, false, nullptr, false, shadowCaster::none, &cubeBounds };
+
 void lightPos(const GLfloat pos[3]) {
-	glDisable(GL_LIGHTING);
-	glPushMatrix(); {
-		glTranslated(pos[0], pos[1], pos[2]);
-		cube(CUBE_WHITE);
-	} glPopMatrix();
-	glEnable(GL_LIGHTING);
+	mat4 marker = identity();
+	for (int i = 0; i < 3; i++) marker.m[12 + i] = pos[i];
+	addInstance(&lightMarkers, marker, CUBE_WHITE);
 }
 
+void interpolateMixer(mixerSettings*, bars*);
+
 bool enableMesh = true;
 GLint meshCount = 128;
-// Object drawing calls
-void drawCalls(const GLboolean main) {
-	lighting();
-	if (main && glIsEnabled(GL_LIGHT0)) lightPos(PointLight.position);
-	if (main && glIsEnabled(GL_LIGHT1)) lightPos(SpotLight.position);
-	mixer(&interactive, &eq);
-	floor(enableMesh, meshCount);
-	table();
+// Records the scene once per frame with model transforms only. Light markers are
+// recorded under the lighting stage, so their vertices are counted apart from the nodes'.
+void recordScene() {
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	clearInstances();
+	if (PointLight.enabled && !PointLight.discoMode) lightPos(PointLight.position);
+	if (SpotLight.enabled) lightPos(SpotLight.position);
+	markStage(stage::scene);
+	mixerSettings shownSettings;
+	bars shownEq;
+	interpolateMixer(&shownSettings, &shownEq);
+	floorResolution(enableMesh, meshCount);
+	recordNodes(&shownSettings, &shownEq);
+	markStage(stage::sort);
+	sortInstances();
 }
 
+// Orthographic inset views, stacked down from the top-right corner
+const struct {
+	vec3 eye;
+	vec3 up;
+} insets[] = {
+	{ { 0, 2, 0 }, { 0, 0, -1 } },	// Top-down view
+	{ { 0, 0, 2 }, { 0, 1, 0 } }	// Front view
+};
+constexpr auto insetSize = 100;
+
 void printStats();
+void wake();
+
+// State changes of the previous frame, shown in the stats overlay
+stateCounters frameStateChanges;
+
+// Text overlay height in pixels, and whether the per-stage timings are shown
+constexpr auto overlayHeight = 490;
+bool showProfile = false;
 
 // Draw calls
 void draw() {
+	pollTextures();
+	beginFrame();
+	markStage(stage::clear);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	frameStateChanges = stateChanges;
+	stateChanges = stateCounters();
+	invalidateState();
+
+	// 2D Viewport for text rendering (GLUT bitmap fonts need a window)
+	if (!headless) {
+		markStage(stage::overlay);
+		glViewport(0, windowHeight - overlayHeight, 100, overlayHeight);
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixf(ortho(0, 100, 0, overlayHeight, -1, 1).m);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadIdentity();
+		printStats();
+	}
 
-	// 2D Viewport for text rendering
-	glViewport(0, windowHeight - 200, 100, 200);
-	glDisable(GL_LIGHTING);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluOrtho2D(0, 100, 0, 200);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	printStats();
-	glEnable(GL_LIGHTING);
+	markStage(stage::lighting);
+	lighting();
+	recordScene();
+	markStage(stage::shadows);
+	renderShadows();
 
 	// Main 3D view
+	markStage(stage::mainView);
 	glViewport(0, 0, windowWidth, windowHeight);
 	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	gluPerspective(Camera.fov, (GLdouble)windowWidth / (GLdouble)windowHeight, 0.1, (double)20 * world);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	Camera.obs[0] = Camera.radius * sin(Camera.theta) * sin(Camera.phi);
-	Camera.obs[1] = Camera.radius * cos(Camera.phi);
-	Camera.obs[2] = Camera.radius * cos(Camera.theta) * sin(Camera.phi);
-	gluLookAt(Camera.obs[0], Camera.obs[1], Camera.obs[2], 0, 0, 0, 0, 1, 0);
-
-	drawCalls(true);
-
-	// Top-down view
-	glViewport(windowWidth - 105, windowHeight - 100, 100, 100);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(-5, 5, -5, 5, -5, 5);
+	glLoadMatrixf(cameraProjection().m);
 	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	gluLookAt(0, 2, 0, 0, 0, 0, 0, 0, -1);
+	glLoadMatrixf(cameraView().m);
 
-	drawCalls(false);
+	drawInstances(true);
 
-	// Front view
-	glViewport(windowWidth - 105, windowHeight - 200, 100, 100);
-	glMatrixMode(GL_PROJECTION);
-	glLoadIdentity();
-	glOrtho(-5, 5, -5, 5, -5, 5);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	gluLookAt(0, 0, 2, 0, 0, 0, 0, 1, 0);
+	// Inset views replay the same recorded scene
+	markStage(stage::insets);
+	for (int i = 0; i < (int)(sizeof insets / sizeof *insets); i++) {
+		glViewport(windowWidth - insetSize - 5, windowHeight - insetSize * (i + 1), insetSize, insetSize);
+		glMatrixMode(GL_PROJECTION);
+		glLoadMatrixf(ortho(-5, 5, -5, 5, -5, 5).m);
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(lookAt(insets[i].eye, { 0, 0, 0 }, insets[i].up).m);
 
-	drawCalls(false);
+		drawInstances(false);
+	}
 
-	glutSwapBuffers();
+	markStage(stage::swap);
+	if (!headless) glutSwapBuffers();
+	else glFinish();
+	endFrame();
 }
 
 // Keyboard (ASCII) event handler
@@ -283,39 +437,39 @@ void keyboard(unsigned char key, int x, int y) {
 	switch (tolower(key)) {
 		// Knob #1
 	case 'q':
-		interactive.knob1 += angleIncrement;
-		if (interactive.knob1 < angleMax) interactive.knob1 = angleMax;
+		interactive.knob[0] += angleIncrement;
+		if (interactive.knob[0] < angleMax) interactive.knob[0] = angleMax;
 		break;
 	case 'a':
-		interactive.knob1 -= angleIncrement;
-		if (interactive.knob1 > angleMin) interactive.knob1 = angleMin;
+		interactive.knob[0] -= angleIncrement;
+		if (interactive.knob[0] > angleMin) interactive.knob[0] = angleMin;
 		break;
 		// Knob #2
 	case 'w':
-		interactive.knob2 += angleIncrement;
-		if (interactive.knob2 < angleMax) interactive.knob2 = angleMax;
+		interactive.knob[1] += angleIncrement;
+		if (interactive.knob[1] < angleMax) interactive.knob[1] = angleMax;
 		break;
 	case 's':
-		interactive.knob2 -= angleIncrement;
-		if (interactive.knob2 > angleMin) interactive.knob2 = angleMin;
+		interactive.knob[1] -= angleIncrement;
+		if (interactive.knob[1] > angleMin) interactive.knob[1] = angleMin;
 		break;
 		// Knob #3
 	case 'e':
-		interactive.knob3 += angleIncrement;
-		if (interactive.knob3 < angleMax) interactive.knob3 = angleMax;
+		interactive.knob[2] += angleIncrement;
+		if (interactive.knob[2] < angleMax) interactive.knob[2] = angleMax;
 		break;
 	case 'd':
-		interactive.knob3 -= angleIncrement;
-		if (interactive.knob3 > angleMin) interactive.knob3 = angleMin;
+		interactive.knob[2] -= angleIncrement;
+		if (interactive.knob[2] > angleMin) interactive.knob[2] = angleMin;
 		break;
 		// Knob #4
 	case 'r':
-		interactive.knob4 += angleIncrement;
-		if (interactive.knob4 < angleMax) interactive.knob4 = angleMax;
+		interactive.knob[3] += angleIncrement;
+		if (interactive.knob[3] < angleMax) interactive.knob[3] = angleMax;
 		break;
 	case 'f':
-		interactive.knob4 -= angleIncrement;
-		if (interactive.knob4 > angleMin) interactive.knob4 = angleMin;
+		interactive.knob[3] -= angleIncrement;
+		if (interactive.knob[3] > angleMin) interactive.knob[3] = angleMin;
 		break;
 		// Slider
 	case 'g':
@@ -327,16 +481,16 @@ void keyboard(unsigned char key, int x, int y) {
 		if (interactive.slider < -0.5) interactive.slider = -0.5;
 		break;
 	case 'z': // Button #1
-		interactive.pressed1 = !interactive.pressed1;
+		interactive.pressed[0] = !interactive.pressed[0];
 		break;
 	case 'x': // Button #2
-		interactive.pressed2 = !interactive.pressed2;
+		interactive.pressed[1] = !interactive.pressed[1];
 		break;
 	case 'c': // Button #3
-		interactive.pressed3 = !interactive.pressed3;
+		interactive.pressed[2] = !interactive.pressed[2];
 		break;
 	case 'v': // Button #4
-		interactive.pressed4 = !interactive.pressed4;
+		interactive.pressed[3] = !interactive.pressed[3];
 		break;
 		// Camera FOV controls
 	case '+':
@@ -349,41 +503,50 @@ void keyboard(unsigned char key, int x, int y) {
 		break;
 		// Lighting
 	case '1':
-		if (Ambient.enabled) glLightModelfv(GL_LIGHT_MODEL_AMBIENT, Ambient.dark);
-		else glLightModelfv(GL_LIGHT_MODEL_AMBIENT, Ambient.light);
 		Ambient.enabled = !Ambient.enabled;
+		lightsChanged = true;
 		break;
 	case '2':
-		if (glIsEnabled(GL_LIGHT1)) glDisable(GL_LIGHT1);
-		else glEnable(GL_LIGHT1);
+		SpotLight.enabled = !SpotLight.enabled;
+		lightsChanged = true;
 		break;
 	case '3':
-		if (glIsEnabled(GL_LIGHT0)) glDisable(GL_LIGHT0);
-		else glEnable(GL_LIGHT0);
+		PointLight.enabled = !PointLight.enabled;
+		lightsChanged = true;
+		break;
+	case '0':
+		PointLight.discoMode = !PointLight.discoMode;
+		lightsChanged = true;
 		break;
 	case '9':
 		PointLight.cycle();
+		lightsChanged = true;
 		break;
 	case '8':
-		if (glIsEnabled(GL_LIGHT0)) PointLight.intensity += 0.05;
+		if (PointLight.enabled) PointLight.intensity += 0.05;
+		lightsChanged = true;
 		break;
 	case '7':
-		if (glIsEnabled(GL_LIGHT0)) {
+		if (PointLight.enabled) {
 			PointLight.intensity -= 0.05;
 			if (PointLight.intensity < 0) PointLight.intensity = 0;
 		}
+		lightsChanged = true;
 		break;
 	case '6':
 		SpotLight.cycle();
+		lightsChanged = true;
 		break;
 	case '5':
-		if (glIsEnabled(GL_LIGHT1)) SpotLight.intensity += 0.1;
+		if (SpotLight.enabled) SpotLight.intensity += 0.1;
+		lightsChanged = true;
 		break;
 	case '4':
-		if (glIsEnabled(GL_LIGHT1)) {
+		if (SpotLight.enabled) {
 			SpotLight.intensity -= 0.1;
 			if (SpotLight.intensity < 0) SpotLight.intensity = 0;
 		}
+		lightsChanged = true;
 		break;
 		// Mesh Controls
 	case 'm':
@@ -395,12 +558,27 @@ void keyboard(unsigned char key, int x, int y) {
 	case '.':
 		meshCount *= 2;
 		break;
+		// Shadow maps and their filtering
+	case 'h':
+		shadowOptions.enabled = !shadowOptions.enabled;
+		lightsChanged = true;
+		break;
+	case 'j':
+		shadowOptions.pcf = !shadowOptions.pcf;
+		lightsChanged = true;
+		break;
+		// Profiler overlay
+	case 'p':
+		showProfile = !showProfile;
+		break;
 		// Quit
 	case 27:
+		closeProfile();
 		glutLeaveMainLoop();
 		exit(0);
 		break;
 	}
+	wake();
 }
 
 // Keyboard (non-ascii) event handler
@@ -426,27 +604,22 @@ void special(int key, int x, int y) {
 		glutFullScreenToggle();
 		break;
 	}
+	wake();
 }
 
-// C++ random generators
-std::random_device rd;
-std::uniform_real_distribution<GLdouble> d(0, 5);
-constexpr auto eqFps = 20, eqMsec = 1000 / eqFps;
+constexpr auto eqFps = 20;
 
-// Create random values for EQ bar scale
-void eqTimer(int value) {
-	glutTimerFunc(eqMsec, eqTimer, 1);
-	GLdouble slider = -interactive.slider + 0.5;
-	if (interactive.pressed1) eq.bar1 = d(rd) * slider;
-	else eq.bar1 = 0;
-	if (interactive.pressed2) eq.bar2 = d(rd) * slider;
-	else eq.bar2 = 0;
-	if (interactive.pressed3) eq.bar3 = d(rd) * slider;
-	else eq.bar3 = 0;
-	if (interactive.pressed4) eq.bar4 = d(rd) * slider;
-	else eq.bar4 = 0;
+// Create random values for EQ bar scale, one batch for all channels
+void sampleEq() {
+	GLdouble slider = -interactive.slider + 0.5, values[channels];
+	fillUniform(&eqRandom, values, channels, 0, 5);
+	for (int i = 0; i < channels; i++) {
+		if (interactive.pressed[i]) eq.bar[i] = values[i] * slider;
+		else eq.bar[i] = 0;
+	}
 }
 
+
 void rasterText(const char *str, GLint x, GLint y) {
 	glColor4d(WHITE);
 	glRasterPos2i(x, y);
@@ -457,13 +630,13 @@ void rasterText(const char *str, GLint x, GLint y) {
 void printStats() {
 	char str[BUFSIZ];
 	const int offset = 15, x = 10;
-	int y = 180;
+	int y = overlayHeight - 20;
 	if (Ambient.enabled) {
 		snprintf(str, sizeof str, "Ambient Intensity: %.2f", Ambient.intensity);
 		rasterText(str, x, y);
 	} else rasterText("Ambient Light off", x, y);
 	y -= offset;
-	if (glIsEnabled(GL_LIGHT1)) {
+	if (SpotLight.enabled) {
 		snprintf(str, sizeof str, "Spot Light Position: (%.2f, %.2f, %.2f)",
 				 SpotLight.position[0], SpotLight.position[1], SpotLight.position[2]);
 		rasterText(str, x, y);
@@ -475,7 +648,7 @@ void printStats() {
 		rasterText(str, x, y);
 	} else rasterText("Spot Light off", x, y);
 	y -= offset;
-	if (glIsEnabled(GL_LIGHT0)) {
+	if (PointLight.enabled) {
 		snprintf(str, sizeof str, "Point Light Position: (%.2f, %.2f, %.2f)",
 				 PointLight.position[0], PointLight.position[1], PointLight.position[2]);
 		rasterText(str, x, y);
@@ -492,35 +665,183 @@ void printStats() {
 		rasterText(str, x, y);
 	}
 	else rasterText("Mesh disabled", x, y);
+	y -= offset;
+	const lightStats lights = lightStatistics();
+	if (lights.clustered)
+		snprintf(str, sizeof str, "Lights: %d (clustered, %.1f avg / %d max per cluster)",
+				 lights.lights, lights.average, lights.max);
+	else snprintf(str, sizeof str, "Lights: %d", lights.lights);
+	rasterText(str, x, y);
+	y -= offset;
+	if (shadowOptions.enabled) {
+		const shadowCounters shadows = shadowStatistics();
+		snprintf(str, sizeof str, "Shadows: %s (%u static / %u moving redraws)",
+				 shadowOptions.pcf ? "PCF" : "single tap", shadows.still, shadows.moving);
+		rasterText(str, x, y);
+	} else rasterText("Shadows off", x, y);
+	y -= offset;
+	const cullStats mainCulling = cullStatistics(true), insetCulling = cullStatistics(false);
+	snprintf(str, sizeof str, "Culling: %u drawn / %u culled (main), %u / %u (insets)",
+			 mainCulling.visible, mainCulling.culled, insetCulling.visible, insetCulling.culled);
+	rasterText(str, x, y);
+	y -= offset;
+	const transformStats transforms = transformStatistics();
+	snprintf(str, sizeof str, "Transforms: %u of %u rebuilt", transforms.updated, transforms.nodes);
+	rasterText(str, x, y);
+	y -= offset;
+	snprintf(str, sizeof str, "State changes: %u (%u skipped)",
+			 frameStateChanges.issued, frameStateChanges.skipped);
+	rasterText(str, x, y);
+
+	y -= offset;
+	const pacerStats pacing = pacerStatistics();
+	snprintf(str, sizeof str, "Pacing: %u frames, %u idle / %u deferred ticks, tick %.0f ms",
+			 pacing.drawn, pacing.idle, pacing.deferred, pacing.tick);
+	rasterText(str, x, y);
+
+	// Frame timings (rolling min/avg/p99 in ms)
+	y -= offset;
+	timingStats frame = frameStats(), interval = intervalStats();
+	snprintf(str, sizeof str, "Frame: %.2f / %.2f / %.2f ms (%.0f fps)",
+			 frame.min, frame.avg, frame.p99, interval.avg > 0 ? 1000 / interval.avg : 0);
+	rasterText(str, x, y);
+	if (!showProfile) return;
+	for (int i = 0; i < (int)stage::count; i++) {
+		y -= offset;
+		timingStats cpu = cpuStats((stage)i), gpu = gpuStats((stage)i);
+		if (gpuTimers())
+			snprintf(str, sizeof str, "  %s: cpu %.2f / %.2f / %.2f, gpu %.2f / %.2f / %.2f", stageName((stage)i),
+					 cpu.min, cpu.avg, cpu.p99, gpu.min, gpu.avg, gpu.p99);
+		else
+			snprintf(str, sizeof str, "  %s: cpu %.2f / %.2f / %.2f", stageName((stage)i), cpu.min, cpu.avg, cpu.p99);
+		rasterText(str, x, y);
+	}
+}
+
+constexpr auto fps = 60;
+
+// Animation rates per simulated second, and simulation steps between EQ samples
+constexpr GLdouble buttonSpeed = 0.6;
+constexpr GLfloat discoSpeed = 0.6;
+constexpr int eqSteps = 1 / (simulationStep * eqFps) + 0.5;
+
+// Animated state as of the previous step, frames are drawn between it and the current one
+struct {
+	GLdouble button[channels] = {};
+	GLdouble bar[channels] = {};
+	GLfloat discoPhase = 0;
+} previousStep;
+long long stepCount = 0;
+
+// Advances the animations by one fixed step
+void step() {
+	for (int i = 0; i < channels; i++) {
+		previousStep.button[i] = interactive.button[i];
+		previousStep.bar[i] = eq.bar[i];
+	}
+	previousStep.discoPhase = discoPhase;
+
+	for (int i = 0; i < channels; i++) {
+		// Smooth press down
+		if (interactive.pressed[i] && interactive.button[i] >= -0.05)
+			interactive.button[i] -= buttonSpeed * simulationStep;
+
+		// Smooth bounce up
+		if (!interactive.pressed[i] && interactive.button[i] <= 0)
+			interactive.button[i] += buttonSpeed * simulationStep;
+	}
+	if (stepCount++ % eqSteps == 0) sampleEq();
+
+	// Stage lights circle the floor
+	if (PointLight.enabled && PointLight.discoMode) {
+		discoPhase += discoSpeed * simulationStep;
+		lightsChanged = true;
+	}
 }
 
-constexpr auto fps = 60, msec = 1000 / fps;
+// Runs as many fixed steps as fit in this much simulated time, up to maxSteps
+void simulate(double seconds, int maxSteps) {
+	for (int steps = advanceClock(seconds, maxSteps); steps > 0; steps--) step();
+}
 
-// Calls glutPostRedisplay at a rate of 60 fps, and handles button animation
-void timer(int value) {
-	glutTimerFunc(msec, timer, 0);
+// The mixer as drawn: buttons and EQ bars part of the way from the previous step to the current one
+void interpolateMixer(mixerSettings* settings, bars* shown) {
+	const GLdouble t = stepFraction();
+	*settings = interactive;
+	*shown = eq;
+	for (int i = 0; i < channels; i++) {
+		settings->button[i] = previousStep.button[i] + (interactive.button[i] - previousStep.button[i]) * t;
+		shown->bar[i] = previousStep.bar[i] + (eq.bar[i] - previousStep.bar[i]) * t;
+	}
+}
 
-	// Smooth press down
-	if (interactive.pressed1 && interactive.button1 >= -0.05)
-		interactive.button1 -= 0.01;
-	if (interactive.pressed2 && interactive.button2 >= -0.05)
-		interactive.button2 -= 0.01;
-	if (interactive.pressed3 && interactive.button3 >= -0.05)
-		interactive.button3 -= 0.01;
-	if (interactive.pressed4 && interactive.button4 >= -0.05)
-		interactive.button4 -= 0.01;
+GLfloat shownPhase() {
+	return previousStep.discoPhase + (discoPhase - previousStep.discoPhase) * stepFraction();
+}
 
-	// Smooth bounce up
-	if (!interactive.pressed1 && interactive.button1 <= 0)
-		interactive.button1 += 0.01;
-	if (!interactive.pressed2 && interactive.button2 <= 0)
-		interactive.button2 += 0.01;
-	if (!interactive.pressed3 && interactive.button3 <= 0)
-		interactive.button3 += 0.01;
-	if (!interactive.pressed4 && interactive.button4 <= 0)
-		interactive.button4 += 0.01;
+// Set once the texture atlas is uploaded, the frame after that is drawn again
+bool texturesReady = false;
 
-	glutPostRedisplay();
+// Whether anything moves on its own: button travel, EQ bars under pressed buttons,
+// the stage lights, or the texture atlas still loading
+bool animating() {
+	for (int i = 0; i < channels; i++) {
+		if (interactive.pressed[i]) return true;
+		if (interactive.button[i] <= 0) return true;
+	}
+	return (PointLight.enabled && PointLight.discoMode) || !texturesReady;
+}
+
+// Everything else a frame depends on, compared by the pacer on every tick
+void watchScene() {
+	watchState(&interactive, sizeof interactive);
+	watchState(&eq, sizeof eq);
+	watchState(&previousStep, sizeof previousStep);
+	watchState(&Camera, sizeof Camera);
+	watchState(&SpotLight, sizeof SpotLight);
+	watchState(&PointLight, sizeof PointLight);
+	watchState(&Ambient, sizeof Ambient);
+	watchState(&windowWidth, sizeof windowWidth);
+	watchState(&windowHeight, sizeof windowHeight);
+	watchState(&enableMesh, sizeof enableMesh);
+	watchState(&meshCount, sizeof meshCount);
+	watchState(&shadowOptions, sizeof shadowOptions);
+	watchState(&showProfile, sizeof showProfile);
+}
+
+// Time beyond this many steps is dropped, so a stalled frame slows the animation down
+// for a moment instead of making every following tick catch up
+constexpr int catchUpSteps = 8;
+
+// Input starts a new tick chain, older chains stop at their next tick
+int tickGeneration = 0;
+int lastTick = 0;
+bool ticking = false;	// Whether the last tick was animating
+
+// Catches the simulation up with real time, and only asks for a frame when
+// something changed; an idle scene ticks at a few Hz and draws nothing
+void timer(int generation) {
+	if (generation != tickGeneration) return;
+	if (!texturesReady && pollTextures()) {
+		texturesReady = true;
+		markDirty();
+	}
+	const int now = glutGet(GLUT_ELAPSED_TIME);
+	// Nothing moved after an idle tick, so the time up to the input that woke the
+	// chain is dropped instead of being simulated with the new input
+	if (!ticking) lastTick = now;
+	simulate(simulationSpeed * (now - lastTick) / 1000, catchUpSteps);
+	lastTick = now;
+	const bool active = animating();
+	ticking = active;
+	if (frameDue(frameStats().avg)) glutPostRedisplay();
+	glutTimerFunc(nextTick(active), timer, generation);
+}
+
+// Answers input at once instead of after an idle tick
+void wake() {
+	markDirty();
+	glutTimerFunc(0, timer, ++tickGeneration);
 }
 
 int prevX = 0, prevY = 0;
@@ -538,15 +859,41 @@ void mouse(int x, int y) {
 
 	prevX = x;
 	prevY = y;
+	wake();
 }
 
-// Mouse wheel handler to control FOV (zoom)
-void wheel(int button, int state, int x, int y) {
+// Toggles the mixer button under a click in the main view, like its key does. The ray
+// runs through the pixel from the near to the far plane.
+void clickButton(int x, int y) {
+	if (x >= windowWidth - insetSize - 5 && y < insetSize * (int)(sizeof insets / sizeof *insets)) return;
+	const mat4 unproject = inverse(cameraProjection() * cameraView());
+	const float ndcX = 2.0f * x / windowWidth - 1, ndcY = 1 - 2.0f * y / windowHeight;
+	const vec4 near = unproject * vec4{ ndcX, ndcY, -1, 1 }, far = unproject * vec4{ ndcX, ndcY, 1, 1 };
+	const vec3 origin = { near.x / near.w, near.y / near.w, near.z / near.w };
+	const vec3 end = { far.x / far.w, far.y / far.w, far.z / far.w };
+	for (int32_t node = pickNode(origin, normalize(end - origin)); node >= 0; node = sceneTables.parent[node]) {
+		if (sceneTables.binding[node] != sceneBinding::button) continue;
+		interactive.pressed[sceneTables.channel[node]] = !interactive.pressed[sceneTables.channel[node]];
+		return;
+	}
+}
+
+int pressX = -1, pressY = -1;
+
+// Mouse button handler: the wheel controls FOV (zoom), a left click without dragging
+// presses the mixer button under it
+void mouseButton(int button, int state, int x, int y) {
+	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+		pressX = x;
+		pressY = y;
+	}
+	if (button == GLUT_LEFT_BUTTON && state == GLUT_UP && x == pressX && y == pressY) clickButton(x, y);
 	if (button == 3 && state == GLUT_DOWN) Camera.radius--;
 	if (button == 4 && state == GLUT_DOWN) Camera.radius++;
 
 	if (Camera.radius < 3) Camera.radius = 3;
 	if (Camera.radius > 50) Camera.radius = 50;
+	wake();
 }
 
 // Reshape handler to ensure resizing of viewport
@@ -556,3 +903,112 @@ void reshape(int w, int h) {
 	windowWidth = w;
 	windowHeight = h;
 }
+
+// Renders a fixed number of frames offscreen, each 1/60 s (times --speed) of simulated
+// time after the last however long it takes to draw, and writes each frame to a BMP file
+int renderHeadless(int frames, const char* out) {
+	if (!initHeadless(windowWidth, windowHeight)) return 1;
+	init();
+	finishTextures();
+	reshape(windowWidth, windowHeight);
+	if (profileFile && !openProfile(profileFile)) return 1;
+
+	for (int frame = 0; frame < frames; frame++) {
+		simulate(simulationSpeed / fps, INT_MAX);
+		draw();
+		if (!dumpFrame(out, frame)) return 1;
+	}
+	closeProfile();
+	return 0;
+}
+
+void enableLights(bool spot, bool point) {
+	SpotLight.enabled = spot;
+	PointLight.enabled = point;
+	lightsChanged = true;
+}
+
+// Renders one benchmark step, calling setup before every frame, and prints its statistics
+void benchStep(const char* name, int frames, const std::function<void(int)>& setup) {
+	resetStats();
+	for (int frame = 0; frame < frames; frame++) {
+		setup(frame);
+		simulate(1.0 / fps, INT_MAX);
+		draw();
+	}
+
+	const timingStats frame = frameStats();
+	double vertices = 0;
+	for (int i = 0; i < (int)stage::count; i++) vertices += verticesPerFrame((stage)i);
+	printf("%-12s %6d %8.1f %8.2f %8.2f %8.2f %12.0f ",
+		   name, frames, 1000 / frame.avg, frame.p50, frame.p99, frame.max, vertices);
+	for (int i = 0; i < (int)stage::count; i++)
+		if (verticesPerFrame((stage)i) > 0) printf(" %s=%.0f", stageName((stage)i), verticesPerFrame((stage)i));
+	printf("\n");
+	fflush(stdout);
+}
+
+// Fixed sequence of camera orbits, mesh sweeps, light toggles and EQ animation
+int runBenchmark() {
+	headless = true;
+	if (!initHeadless(windowWidth, windowHeight)) return 1;
+	init();
+	finishTextures();
+	reshape(windowWidth, windowHeight);
+	if (profileFile && !openProfile(profileFile)) return 1;
+
+	const GLdouble radius = Camera.radius, theta = Camera.theta, phi = Camera.phi;
+	enableLights(true, true);
+
+	printf("%-12s %6s %8s %8s %8s %8s %12s  per stage\n",
+		   "step", "frames", "fps", "p50 ms", "p99 ms", "max ms", "vertices");
+	benchStep("warmup", 10, [](int) {});
+
+	benchStep("orbit", 120, [](int frame) {
+		Camera.theta = 2 * M_PI * frame / 120;
+		Camera.phi = M_PI / 3 + 0.3 * sin(4 * M_PI * frame / 120);
+		Camera.radius = 10 + 5 * sin(2 * M_PI * frame / 120);
+	});
+	Camera.radius = radius;
+	Camera.theta = theta;
+	Camera.phi = phi;
+
+	const GLint mesh = meshCount;
+	for (GLint count = 1; count <= 2048; count *= 2) {
+		char name[32];
+		snprintf(name, sizeof name, "mesh %d", count);
+		benchStep(name, 20, [count](int) { meshCount = count; });
+	}
+	meshCount = mesh;
+
+	const char* lightNames[] = { "lights off", "spot", "point", "both lights" };
+	for (int lights = 0; lights < 4; lights++) {
+		benchStep(lightNames[lights], 30, [lights](int) {
+			enableLights(lights & 1, lights & 2);
+		});
+	}
+
+	// Shadow cost against the PCF "both lights" step: single tap, then no shadows
+	enableLights(true, true);
+	shadowOptions.pcf = false;
+	benchStep("shadows 1tap", 30, [](int) {});
+	shadowOptions.enabled = false;
+	lightsChanged = true;
+	benchStep("shadows off", 30, [](int) {});
+	shadowOptions = shadowSettings();
+	lightsChanged = true;
+
+	PointLight.discoMode = true;
+	benchStep("disco", 60, [](int) {
+		discoPhase += 0.01;
+		lightsChanged = true;
+	});
+	PointLight.discoMode = false;
+	lightsChanged = true;
+
+	for (int i = 0; i < channels; i++) interactive.pressed[i] = true;
+	benchStep("eq", 120, [](int) {});
+
+	closeProfile();
+	return 0;
+}
@@ -1,4 +1,7 @@
+#include <map>
+
 #include "include/materials.h"
+#include "include/shaders.h"
 
 // Material table: http://devernay.free.fr/cours/opengl/materials.html
 
@@ -54,43 +57,81 @@ struct {
 	4: Silver
 	5: Glass
 */
-void initMaterial(materials material) {
-	switch (material) {
-	case materials::blackPlastic:
-		glMaterialfv(GL_FRONT, GL_AMBIENT, BlackPlastic.ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, BlackPlastic.diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, BlackPlastic.specular);
-		glMaterialf(GL_FRONT, GL_SHININESS, BlackPlastic.shininess);
-		break;
-	case materials::grayPlastic:
-		glMaterialfv(GL_FRONT, GL_AMBIENT, GrayPlastic.ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, GrayPlastic.diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, GrayPlastic.specular);
-		glMaterialf(GL_FRONT, GL_SHININESS, GrayPlastic.shininess);
-		break;
-	case materials::redPlastic:
-		glMaterialfv(GL_FRONT, GL_AMBIENT, RedPlastic.ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, RedPlastic.diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, RedPlastic.specular);
-		glMaterialf(GL_FRONT, GL_SHININESS, RedPlastic.shininess);
-		break;
-	case materials::whitePlastic:
-		glMaterialfv(GL_FRONT, GL_AMBIENT, WhitePlastic.ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, WhitePlastic.diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, WhitePlastic.specular);
-		glMaterialf(GL_FRONT, GL_SHININESS, WhitePlastic.shininess);
-		break;
-	case materials::silver:
-		glMaterialfv(GL_FRONT, GL_AMBIENT, Silver.ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, Silver.diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, Silver.specular);
-		glMaterialf(GL_FRONT, GL_SHININESS, Silver.shininess);
-		break;
-	case materials::glass:
-		glMaterialfv(GL_FRONT, GL_AMBIENT, Glass.ambient);
-		glMaterialfv(GL_FRONT, GL_DIFFUSE, Glass.diffuse);
-		glMaterialfv(GL_FRONT, GL_SPECULAR, Glass.specular);
-		glMaterialf(GL_FRONT, GL_SHININESS, Glass.shininess);
-		break;
+stateCounters stateChanges;
+
+// Last state sent to GL, unknown entries are always issued
+struct {
+	GLint texture = -1;
+	const atlasRegion* region = nullptr;
+	std::map<GLenum, GLboolean> enabled;
+} bound;
+
+void invalidateState() {
+	bound.texture = -1;
+	bound.region = nullptr;
+	bound.enabled.clear();
+}
+
+void setEnabled(GLenum capability, GLboolean enable) {
+	auto state = bound.enabled.find(capability);
+	if (state != bound.enabled.end() && state->second == enable) {
+		stateChanges.skipped++;
+		return;
+	}
+	if (enable) glEnable(capability);
+	else glDisable(capability);
+	bound.enabled[capability] = enable;
+	stateChanges.issued++;
+}
+
+void bindTexture(GLuint texture) {
+	setEnabled(GL_TEXTURE_2D, texture != 0);
+	if (!texture) return;
+	if (bound.texture == (GLint)texture) {
+		stateChanges.skipped++;
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	bound.texture = texture;
+	stateChanges.issued++;
+}
+
+void bindRegion(const atlasRegion* region) {
+	bindTexture(region ? atlas : 0);
+	if (!region) return;
+	if (bound.region == region) {
+		stateChanges.skipped++;
+		return;
 	}
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glTranslatef(region->offset[0], region->offset[1], 0);
+	glScalef(region->scale[0], region->scale[1], 1);
+	glMatrixMode(GL_MODELVIEW);
+	bound.region = region;
+	stateChanges.issued++;
+}
+
+// Packs one table entry for the materials uniform block
+template<typename T>
+shaderMaterial pack(const T& m, GLfloat alpha) {
+	return {
+		{ m.ambient[0], m.ambient[1], m.ambient[2], 1 },
+		{ m.diffuse[0], m.diffuse[1], m.diffuse[2], alpha },
+		{ m.specular[0], m.specular[1], m.specular[2], m.shininess }
+	};
+}
+
+void materialTable(shaderMaterial* table) {
+	table[(int)materials::blackPlastic] = pack(BlackPlastic, 1);
+	table[(int)materials::grayPlastic] = pack(GrayPlastic, 1);
+	table[(int)materials::redPlastic] = pack(RedPlastic, 1);
+	table[(int)materials::whitePlastic] = pack(WhitePlastic, 1);
+	table[(int)materials::silver] = pack(Silver, 1);
+	table[(int)materials::glass] = pack(Glass, Glass.diffuse[3]);
+}
+
+// The whole table lives in a uniform buffer, a draw only selects its entry
+void initMaterial(materials material) {
+	setMaterial((GLint)material);
 }
\ No newline at end of file
@@ -2,306 +2,70 @@
 
 #include "include/objects.h"
 #include "include/geometry.h"
-#include "include/palette.h"
-#include "include/materials.h"
-#include "include/textures.h"
 
-void slider(const GLdouble* pos) {
-	const GLdouble baseWidth = 0.5, baseHeight = 0.2, baseDepth = 0.2;
-	const GLdouble accentWidth = 0.75 * baseWidth, accentHeight = 0.5 * baseHeight, accentDepth = 0.5 * baseDepth;
-	GLdouble base[] = {
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY
-	};
+const aabb lineBounds = { { 0, 0, -0.5 }, { 0, 0, 0.5 } };
+const aabb floorBounds = { { -1, -1, 0 }, { 1, 1, 0 } };	// Any grid resolution
 
-	GLdouble accent[] = {
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE,
-		WHITE, WHITE, WHITE, WHITE
-	};
+meshBuffer line;
 
-	// Slider horizontal line
-	initMaterial(materials::whitePlastic);
+// Lines are drawn 2 pixels wide, which is set here as the batch has no other hook
+const meshBuffer* sliderLine(const lodView&, const GLfloat*) {
+	if (!line.count) uploadMesh(&line, { {0, 0, 0, 1, 0, 0, 0, -0.5}, {1, 0, 0, 1, 0, 0, 0, 0.5} }, {0, 1}, GL_LINES);
 	glLineWidth(2);
-	glBegin(GL_LINES); {
-		glVertex3d(0, 0, -0.5);
-		glVertex3d(0, 0, 0.5);
-	} glEnd();
-
-	glPushMatrix(); {
-		// Slides the control over the line
-		glTranslated(0, 0, *pos);
-
-		// Slider Accent
-		glPushMatrix(); {
-			glTranslated(0, 0.75 * accentHeight, 0);
-			glScaled(accentWidth, accentHeight, accentDepth);
-			cube(accent);
-		} glPopMatrix();
-
-		// Base control
-		initMaterial(materials::blackPlastic);
-		glPushMatrix(); {
-			glScaled(baseWidth, baseHeight, baseDepth);
-			cube(base);
-		} glPopMatrix();
-
-
-	} glPopMatrix();
+	return &line;
 }
 
-void knob(const GLdouble* angle) {
-	GLdouble red[] = {
-		RED, RED, RED, RED,
-		RED, RED, RED, RED,
-		RED, RED, RED, RED,
-		RED, RED, RED, RED,
-		RED, RED, RED, RED,
-		RED, RED, RED, RED
-	};
-	glPushMatrix(); {
-		initMaterial(materials::blackPlastic);
-		glRotated(*angle, 0, 1, 0);
-		glColor4d(LIGHTGRAY);
-		glPushMatrix(); {
-			glScaled(0.2, 0.3, 0.2);
-			glRotated(90, 1, 0, 0);
-			glTranslated(0, 0, -0.5);
-			glutSolidCylinder(1, 1, 50, 50);
-		} glPopMatrix();
-
-		initMaterial(materials::redPlastic);
-		glPushMatrix(); {
-			glTranslated(0, 0.02, 0.1);
-			glScaled(0.05, 0.34, 0.2);
-			cube(red);
-		} glPopMatrix();
-	} glPopMatrix();
-}
-
-void button() {
-	initMaterial(materials::redPlastic);
-	glPushMatrix(); {
-		glScaled(0.1, 0.15, 0.1);
-		glRotated(90, 1, 0, 0);
-		glTranslated(0, 0, -0.5);
-		glutSolidCylinder(1, 1, 50, 50);
-	} glPopMatrix();
-}
-
-void equalizer(const bars* eq, const mixerSettings* interactive) {
-	glDisable(GL_LIGHTING);
-	constexpr auto spacing = 0.5;
-
-	const GLdouble colours[] = {
-		GREEN, GREEN, GREEN, GREEN,
-		GREEN, GREEN, GREEN, GREEN,
-		GREEN, GREEN, GREEN, GREEN,
-		GREEN, GREEN, GREEN, GREEN,
-		GREEN, GREEN, GREEN, GREEN,
-		GREEN, GREEN, GREEN, GREEN
-	};
-
-	initMaterial(materials::redPlastic);
-	glPushMatrix(); {
-		//glScaled(1, 1, 0);
-		if (interactive->pressed1) {
-			glPushMatrix(); {
-				glTranslated(-1.8, 0, 0);
-				glScaled(1, 1, eq->bar1);
-				cube(colours);
-			} glPopMatrix();
-		}
-		if (interactive->pressed2) {
-			glPushMatrix(); {
-				glTranslated(-0.6, 0, 0);
-				glScaled(1, 1, eq->bar2);
-				cube(colours);
-			} glPopMatrix();
+// Floor grid cache, rebuilt only when the mesh resolution changes
+struct {
+	meshBuffer buffer;
+	GLint dim = 0;
+} floorGrid, floorQuad;
+
+// Builds a dim x dim grid spanning [-1, 1] as a single triangle strip,
+// rows are joined with degenerate triangles
+void buildGrid(meshBuffer* grid, GLint dim) {
+	std::vector<vertex> vertices;
+	std::vector<GLuint> indices;
+	vertices.reserve((dim + 1) * (dim + 1));
+	indices.reserve(2 * (dim + 1) * dim + 2 * dim);
+
+	for (int i = 0; i <= dim; i++)
+		for (int j = 0; j <= dim; j++) {
+			GLfloat s = (GLfloat)j / dim, t = (GLfloat)i / dim;
+			vertices.push_back({s, t, 0, 0, 1, 2 * s - 1, 2 * t - 1, 0});
 		}
-		if (interactive->pressed3) {
-			glPushMatrix(); {
-				glTranslated(0.6, 0, 0);
-				glScaled(1, 1, eq->bar3);
-				cube(colours);
-			} glPopMatrix();
-		}
-		if (interactive->pressed4) {
-			glPushMatrix(); {
-				glTranslated(1.8, 0, 0);
-				glScaled(1, 1, eq->bar4);
-				cube(colours);
-			} glPopMatrix();
-		}
-	} glPopMatrix();
-
-	glEnable(GL_LIGHTING);
-}
 
-void mixer(const mixerSettings* interactive, const bars* eq) {
-	const GLdouble width = 6, height = 1, depth = 4;
-	const GLdouble base[] = {
-		GRAY, GRAY, GRAY, GRAY,	// Left
-		GRAY, GRAY, GRAY, GRAY,	// Right
-		GRAY, GRAY, GRAY, GRAY,	// Top (Maybe change this to a dark accent colour?)
-		GRAY, GRAY, GRAY, GRAY,	// Bottom
-		GRAY, GRAY, GRAY, GRAY,	// Front
-		GRAY, GRAY, GRAY, GRAY	// Back
-	};
-
-	const GLdouble sides[] = {
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,	// Left
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,	// Right
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,	// Top (Maybe change this to a dark accent colour?)
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,	// Bottom
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY,	// Front
-		LIGHTGRAY, LIGHTGRAY, LIGHTGRAY, LIGHTGRAY	// Back
-	};
-
-	initMaterial(materials::blackPlastic);
-	glPushMatrix(); {
-		glScaled(width, height, depth);
-		cube(base);
-	} glPopMatrix();
-
-	initMaterial(materials::silver);
-	for (int i = -1; i <= 1; i += 2) {
-		glEnable(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, metal);
-		glPushMatrix(); {
-			glTranslated(width / 2 * i, 0, 0);
-			glScaled(1, height + 0.1, depth + 0.1);
-			cube(sides);
-		} glPopMatrix();
-		glDisable(GL_TEXTURE_2D);
+	for (int i = 0; i < dim; i++) {
+		if (i > 0) indices.push_back((i + 1) * (dim + 1));
+		for (int j = 0; j <= dim; j++) {
+			indices.push_back((i + 1) * (dim + 1) + j);
+			indices.push_back(i * (dim + 1) + j);
+		}
+		if (i < dim - 1) indices.push_back(i * (dim + 1) + dim);
 	}
-	
-	const GLdouble offset = -width / 2 + 1;
-
-	glPushMatrix(); {
-		// Knob height: 0.3 -> Half: 0.15
-		glTranslated(offset, height / 2 + 0.15, 1);
-		knob(&interactive->knob1);
-		glTranslated(0, -0.15 / 2 + interactive->button1, 0.5);
-		button();
-	} glPopMatrix();
-
-	glPushMatrix(); {
-		// Knob height: 0.3 -> Half: 0.15
-		glTranslated(offset + 1, height / 2 + 0.15, 1);
-		knob(&interactive->knob2);
-		glTranslated(0, -0.15 / 2 + interactive->button2, 0.5);
-		button();
-	} glPopMatrix();
-
-	glPushMatrix(); {
-		// Knob height: 0.3 -> Half: 0.15
-		glTranslated(offset + 2, height / 2 + 0.15, 1);
-		knob(&interactive->knob3);
-		glTranslated(0, -0.15 / 2 + interactive->button3, 0.5);
-		button();
-	} glPopMatrix();
-
-	glPushMatrix(); {
-		// Knob height: 0.3 -> Half: 0.15
-		glTranslated(offset + 3, height / 2 + 0.15, 1);
-		knob(&interactive->knob4);
-		glTranslated(0, -0.15 / 2 + interactive->button4, 0.5);
-		button();
-	} glPopMatrix();
-
-	glPushMatrix(); {
-		glTranslated(offset + 4, height / 2, 1);
-		glScaled(1, 1, 1);
-		slider(&interactive->slider);
-	} glPopMatrix();
 
-
-	glPushMatrix(); {
-		glTranslated(0, (height + 1) / 2, -1);
-		glRotated(45, 1, 0, 0);
-		glPushMatrix(); {
-			glScaled(width / 2, 0.1, depth / 2);
-			cube(sides);
-		} glPopMatrix();
-
-		// Draw equalizer
-		glPushMatrix(); {
-			glTranslated(0, 0.15, 0.08);
-			glScaled(0.25, 0.1, 0.25);
-			equalizer(eq, interactive);
-		} glPopMatrix();
-	} glPopMatrix();
+	uploadMesh(grid, vertices, indices, GL_TRIANGLE_STRIP);
 }
 
-void table() {
-	glBindTexture(GL_TEXTURE_2D, wood);
-	glEnable(GL_TEXTURE_2D);
-	initMaterial(materials::silver);
-	for (int i = -1; i < 2; i += 2) {
-		for (int j = -1; j < 2; j += 2) {
-			glPushMatrix(); {
-				glTranslated(4.5* i, -2.5, 2.5 * j);
-				glScaled(0.5, 3, 0.5);
-				cube(NULL);
-			} glPopMatrix();
-		}
-	}
-	glDisable(GL_TEXTURE_2D);
+meshBuffer noGrid;
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	initMaterial(materials::glass);
-	glPushMatrix(); {
-		glTranslated(0, -0.75, 0);
-		glScaled(10, 0.5, 6);
-		cube(NULL);
-	} glPopMatrix();
-	glDisable(GL_BLEND);
+const meshBuffer* mesh(GLint dim) {
+	if (dim <= 0) return &noGrid;
+	auto& grid = dim == 1 ? floorQuad : floorGrid;
+	if (grid.dim != dim) {
+		buildGrid(&grid.buffer, dim);
+		grid.dim = dim;
+	}
+	return &grid.buffer;
 }
 
-void mesh(GLint dim) {
-	int i, j;
-	GLdouble med_dim = (GLdouble)dim / 2;
-	glPushMatrix();
-	glTranslatef(-1.0, -1.0, 0);  // meio do poligono 
-
-	glNormal3f(0, 0, 1);          //normal 
+// Resolution used by floorMesh() for the current frame
+GLint floorDim = 1;
 
-	glBegin(GL_QUADS);
-	for (i = 0; i < dim; i++)
-		for (j = 0; j < dim; j++) {
-			glTexCoord2f((GLdouble)j / dim, (GLdouble)i / dim);
-			glVertex3d((GLdouble)j / med_dim, (GLdouble)i / med_dim, 0);
-			glTexCoord2f((GLdouble)(j + 1) / dim, (GLdouble)i / dim);
-			glVertex3d((GLdouble)(j + 1) / med_dim, (GLdouble)i / med_dim, 0);
-			glTexCoord2f((GLdouble)(j + 1) / dim, (GLdouble)(i + 1) / dim);
-			glVertex3d((GLdouble)(j + 1) / med_dim, (GLdouble)(i + 1) / med_dim, 0);
-			glTexCoord2f((GLdouble)j / dim, (GLdouble)(i + 1) / dim);
-			glVertex3d((GLdouble)j / med_dim, (GLdouble)(i + 1) / med_dim, 0);
-		}
-	glEnd();
-	glPopMatrix();
+const meshBuffer* floorMesh(const lodView&, const GLfloat*) {
+	return mesh(floorDim);
 }
 
-void floor(bool enableMesh, GLint meshCount) {
-	initMaterial(materials::silver);
-
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, flooring);
-	glPushMatrix(); {
-		glTranslated(0, -4, 0);
-		glScaled(10, 1, 10);
-		glRotated(-90, 1, 0, 0);
-		if (enableMesh) mesh(meshCount);
-		else mesh(1);
-	} glPopMatrix();
-	glDisable(GL_TEXTURE_2D);
+void floorResolution(bool enableMesh, GLint meshCount) {
+	floorDim = enableMesh ? meshCount : 1;
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "include/pacer.h"
+
+using steady = std::chrono::steady_clock;
+
+constexpr double frameMsec = 1000.0 / 60;	// Tick while animating, and the shortest frame interval
+constexpr double idleMsec = 250;			// Longest tick while nothing changes
+
+// Byte snapshot of one watched object, compared on every tick
+struct watched {
+	const void* data;
+	size_t size;
+	std::vector<char> last;
+};
+
+struct {
+	std::vector<watched> state;
+	bool dirty = true;
+	bool pending = false;	// A change is waiting for the frame budget
+	double tick = frameMsec;
+	steady::time_point lastFrame;
+	pacerStats stats;
+} pacer;
+
+void watchState(const void* data, size_t size) {
+	const char* bytes = (const char*)data;
+	pacer.state.push_back({ data, size, std::vector<char>(bytes, bytes + size) });
+}
+
+void markDirty() {
+	pacer.dirty = true;
+}
+
+bool stateChanged() {
+	bool changed = false;
+	for (auto& w : pacer.state) {
+		if (!memcmp(w.last.data(), w.data, w.size)) continue;
+		memcpy(w.last.data(), w.data, w.size);
+		changed = true;
+	}
+	return changed;
+}
+
+// The frame budget is the larger of the 60 fps interval and what the last frames cost, so a
+// slow scene is drawn less often instead of queueing frames and starving input
+bool frameDue(double frameMs) {
+	pacer.pending |= stateChanged() || pacer.dirty;
+	pacer.dirty = false;
+	if (!pacer.pending) {
+		pacer.stats.idle++;
+		return false;
+	}
+
+	const steady::time_point now = steady::now();
+	const double since = std::chrono::duration<double, std::milli>(now - pacer.lastFrame).count();
+	if (since < std::max(frameMsec, frameMs)) {
+		pacer.stats.deferred++;
+		return false;
+	}
+	pacer.pending = false;
+	pacer.lastFrame = now;
+	pacer.stats.drawn++;
+	return true;
+}
+
+// Ticks at the frame rate while something animates or waits to be drawn, otherwise
+// doubles the interval up to idleMsec
+int nextTick(bool animating) {
+	pacer.tick = animating || pacer.pending ? frameMsec : std::min(2 * pacer.tick, idleMsec);
+	pacer.stats.tick = pacer.tick;
+	return (int)lround(pacer.tick);
+}
+
+pacerStats pacerStatistics() {
+	return pacer.stats;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "include/profiler.h"
+
+using steady = std::chrono::steady_clock;
+
+constexpr int stages = (int)stage::count;
+constexpr int window = 120;		// Frames kept for rolling statistics
+constexpr int latency = 4;		// Frames in flight before GPU timestamps are read back
+
+const char* stageNames[stages] = {
+	"clear", "overlay", "lighting", "scene", "sort", "shadows", "main", "insets", "swap"
+};
+
+// Frame whose GPU timestamps have not been read back yet
+struct pendingFrame {
+	int number = -1;
+	int marks = 0;
+	stage order[stages];
+	double cpu[stages];
+	double vertices[stages];
+	double frame;
+	GLuint queries[stages + 1];
+};
+
+// Ring buffer of the last window samples
+struct history {
+	double samples[window];
+	int count = 0;
+
+	void push(double value) { samples[count++ % window] = value; }
+
+	timingStats stats() const {
+		timingStats result;
+		const int n = std::min(count, window);
+		if (!n) return result;
+		double sorted[window];
+		std::copy(samples, samples + n, sorted);
+		std::sort(sorted, sorted + n);
+		result.min = sorted[0];
+		for (int i = 0; i < n; i++) result.avg += sorted[i];
+		result.avg /= n;
+		result.p50 = sorted[std::max(0, (50 * n + 99) / 100 - 1)];
+		result.p99 = sorted[std::max(0, (99 * n + 99) / 100 - 1)];
+		result.max = sorted[n - 1];
+		return result;
+	}
+};
+
+struct {
+	bool initialised = false;
+	bool timers = false;
+	FILE* csv = NULL;
+	int frame = 0;
+	stage charged = stage::count;	// Where submitted vertices go
+	steady::time_point start, mark, previousStart;
+	pendingFrame pending[latency];
+	history cpu[stages], gpu[stages], vertices[stages], frames, intervals;
+} profiler;
+
+double milliseconds(steady::duration d) {
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// Reads back the GPU timestamps of a finished frame and writes its CSV row
+void resolve(pendingFrame* p) {
+	double gpu[stages] = {};
+	if (profiler.timers && p->marks) {
+		GLuint64 timestamps[stages + 1];
+		for (int i = 0; i <= p->marks; i++)
+			glGetQueryObjectui64v(p->queries[i], GL_QUERY_RESULT, &timestamps[i]);
+		for (int i = 0; i < p->marks; i++)
+			gpu[(int)p->order[i]] += (timestamps[i + 1] - timestamps[i]) / 1e6;
+		for (int s = 0; s < stages; s++) profiler.gpu[s].push(gpu[s]);
+	}
+
+	if (profiler.csv) {
+		fprintf(profiler.csv, "%d,%.4f", p->number, p->frame);
+		for (int s = 0; s < stages; s++) fprintf(profiler.csv, ",%.4f", p->cpu[s]);
+		for (int s = 0; s < stages; s++) fprintf(profiler.csv, ",%.0f", p->vertices[s]);
+		if (profiler.timers) for (int s = 0; s < stages; s++) fprintf(profiler.csv, ",%.4f", gpu[s]);
+		fprintf(profiler.csv, "\n");
+	}
+	p->number = -1;
+}
+
+void beginFrame() {
+	if (!profiler.initialised) {
+		GLint bits = 0;
+		glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+		glGetError();	// Timer queries may be unsupported
+		profiler.timers = bits > 0;
+		if (profiler.timers) for (auto& p : profiler.pending) glGenQueries(stages + 1, p.queries);
+		profiler.initialised = true;
+	}
+
+	pendingFrame* p = &profiler.pending[profiler.frame % latency];
+	if (p->number >= 0) resolve(p);
+	p->number = profiler.frame;
+	p->marks = 0;
+	std::fill(p->cpu, p->cpu + stages, 0);
+	std::fill(p->vertices, p->vertices + stages, 0);
+	profiler.charged = stage::count;
+
+	profiler.start = profiler.mark = steady::now();
+	if (profiler.frame > 0) profiler.intervals.push(milliseconds(profiler.start - profiler.previousStart));
+	profiler.previousStart = profiler.start;
+}
+
+void markStage(stage s) {
+	pendingFrame* p = &profiler.pending[profiler.frame % latency];
+	if (p->marks == stages) return;
+	const steady::time_point now = steady::now();
+	if (p->marks) p->cpu[(int)p->order[p->marks - 1]] += milliseconds(now - profiler.mark);
+	if (profiler.timers) glQueryCounter(p->queries[p->marks], GL_TIMESTAMP);
+	p->order[p->marks++] = s;
+	profiler.mark = now;
+	profiler.charged = s;
+}
+
+void endFrame() {
+	pendingFrame* p = &profiler.pending[profiler.frame % latency];
+	const steady::time_point now = steady::now();
+	if (p->marks) p->cpu[(int)p->order[p->marks - 1]] += milliseconds(now - profiler.mark);
+	if (profiler.timers) glQueryCounter(p->queries[p->marks], GL_TIMESTAMP);
+	p->frame = milliseconds(now - profiler.start);
+
+	for (int s = 0; s < stages; s++) {
+		profiler.cpu[s].push(p->cpu[s]);
+		profiler.vertices[s].push(p->vertices[s]);
+	}
+	profiler.frames.push(p->frame);
+	if (!profiler.timers) resolve(p);
+	profiler.frame++;
+}
+
+void countVertices(GLuint vertices) {
+	pendingFrame* p = &profiler.pending[profiler.frame % latency];
+	if (profiler.charged != stage::count) p->vertices[(int)profiler.charged] += vertices;
+}
+
+stage currentStage() {
+	const pendingFrame* p = &profiler.pending[profiler.frame % latency];
+	return p->marks ? p->order[p->marks - 1] : stage::count;
+}
+
+void chargeVertices(stage s) {
+	profiler.charged = s;
+}
+
+const char* stageName(stage s) {
+	return stageNames[(int)s];
+}
+
+bool gpuTimers() {
+	return profiler.timers;
+}
+
+timingStats cpuStats(stage s) {
+	return profiler.cpu[(int)s].stats();
+}
+
+timingStats gpuStats(stage s) {
+	return profiler.gpu[(int)s].stats();
+}
+
+timingStats frameStats() {
+	return profiler.frames.stats();
+}
+
+timingStats intervalStats() {
+	return profiler.intervals.stats();
+}
+
+double verticesPerFrame(stage s) {
+	return profiler.vertices[(int)s].stats().avg;
+}
+
+// Starts the rolling statistics over, e.g. between benchmark steps
+void resetStats() {
+	for (int s = 0; s < stages; s++) {
+		profiler.cpu[s].count = 0;
+		profiler.gpu[s].count = 0;
+		profiler.vertices[s].count = 0;
+	}
+	profiler.frames.count = 0;
+	profiler.intervals.count = 0;
+}
+
+// Per-frame CSV dump, GPU columns are only written when timer queries are available.
+// Must be called with a current GL context, before the first frame
+bool openProfile(const char* csvFile) {
+	profiler.csv = fopen(csvFile, "w");
+	if (!profiler.csv) {
+		fprintf(stderr, "Unable to open file: %s\n", csvFile);
+		return false;
+	}
+
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	glGetError();
+	fprintf(profiler.csv, "frame,frame_ms");
+	for (int s = 0; s < stages; s++) fprintf(profiler.csv, ",%s_cpu_ms", stageNames[s]);
+	for (int s = 0; s < stages; s++) fprintf(profiler.csv, ",%s_vertices", stageNames[s]);
+	if (bits > 0) for (int s = 0; s < stages; s++) fprintf(profiler.csv, ",%s_gpu_ms", stageNames[s]);
+	fprintf(profiler.csv, "\n");
+	return true;
+}
+
+// Reads back the frames still in flight and closes the CSV file
+void closeProfile() {
+	for (int i = 0; i < latency; i++) {
+		pendingFrame* p = &profiler.pending[(profiler.frame + i) % latency];
+		if (p->number >= 0) resolve(p);
+	}
+	if (profiler.csv) fclose(profiler.csv);
+	profiler.csv = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#include "include/random.h"
+
+static uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+// The state is expanded from the seed with splitmix64, so nearby seeds give unrelated streams
+void seedRandom(randomState* state, uint64_t seed) {
+	for (auto& word : state->s) {
+		uint64_t z = (seed += 0x9e3779b97f4a7c15);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+		word = z ^ (z >> 31);
+	}
+}
+
+uint64_t nextRandom(randomState* state) {
+	uint64_t* s = state->s;
+	const uint64_t result = rotl(s[1] * 5, 7) * 9;
+	const uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+	return result;
+}
+
+// The state stays in registers across the whole array, and the top 53 bits of each
+// number make a double in [0, 1) with one multiply
+void fillUniform(randomState* state, double* out, int count, double min, double max) {
+	randomState local = *state;
+	const double scale = (max - min) * 0x1.0p-53;
+	for (int i = 0; i < count; i++) out[i] = min + (nextRandom(&local) >> 11) * scale;
+	*state = local;
+}
\ No newline at end of file
@@ -0,0 +1,429 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/scene.h"
+#include "include/geometry.h"
+#include "include/materials.h"
+#include "include/textures.h"
+#include "include/texturedata.h"
+#include "include/instancing.h"
+#include "include/transforms.h"
+
+sceneNodes sceneTables;
+
+// Columns of a scene parsed from text, the tables point into these or into the mapped cache
+struct {
+	std::vector<int32_t> parent, batch;
+	std::vector<sceneBinding> binding;
+	std::vector<uint8_t> channel;
+	std::vector<GLfloat> translate, rotate, scale, color;
+	std::vector<sceneBatch> batches;
+	void* mapping = nullptr;
+	size_t mappingSize = 0;
+
+	std::vector<instanceBatch> instances;	// One per scene batch
+	std::vector<uint32_t> bound;	// Nodes with a binding, the only ones whose local transform changes
+	std::vector<GLfloat> colors;	// 4 per node, as the draw list takes them
+	std::vector<GLboolean> visible;
+	std::vector<aabb> boxes;	// World space, redone when the node's world matrix is
+	std::vector<GLboolean> animated;	// Bound nodes and everything under them
+	bvh still, moving;	// Spatial index over the visible meshes, by node
+	GLboolean indexed = false;
+} scene;
+
+// Names used by the text format, indexed by their enums
+const char* const meshNames[] = { "none", "cube", "cylinder", "line", "floor" };
+const char* const materialNames[] = { "blackPlastic", "grayPlastic", "redPlastic", "whitePlastic", "silver", "glass" };
+const char* const textureNames[] = { "none", "wood", "metal", "floor" };
+const char* const shadowNames[] = { "none", "still", "moving" };
+const char* const bindingNames[] = { "none", "knob", "button", "slider", "eq" };
+const meshBuffer* (* const meshShapes[])(const lodView&, const GLfloat*) = { nullptr, cube, cylinder, sliderLine, floorMesh };
+const aabb* const meshBounds[] = { nullptr, &cubeBounds, &cylinderBounds, &lineBounds, &floorBounds };
+const atlasRegion* const textureRegions[] = { nullptr, &wood, &metal, &flooring };
+
+template <size_t n>
+int lookup(const char* const (&names)[n], const char* name) {
+	for (size_t i = 0; i < n; i++)
+		if (!strcmp(names[i], name)) return i;
+	return -1;
+}
+
+void clearScene() {
+	if (scene.mapping) munmap(scene.mapping, scene.mappingSize);
+	scene.mapping = nullptr;
+	for (auto* column : { &scene.parent, &scene.batch }) column->clear();
+	for (auto* column : { &scene.translate, &scene.rotate, &scene.scale, &scene.color }) column->clear();
+	scene.binding.clear();
+	scene.channel.clear();
+	scene.batches.clear();
+	sceneTables = sceneNodes();
+}
+
+// Parses the fields after "node <name>" into a new row, returns what was wrong otherwise
+const char* parseNode(const std::unordered_map<std::string, int32_t>& names) {
+	sceneBatch batch = { sceneMesh::none, 0, 0, (uint8_t)shadowCaster::still, true, false, true, 0 };
+	int32_t parent = -1;
+	sceneBinding binding = sceneBinding::none;
+	int channel = 0;
+	GLfloat translate[3] = { 0, 0, 0 }, rotate[4] = { 0, 0, 1, 0 }, scale[3] = { 1, 1, 1 }, color[4] = { WHITE };
+
+	for (char* token; (token = strtok(NULL, " \t\r\n"));) {
+		char* value = strchr(token, '=');
+		if (!value) {
+			if (!strcmp(token, "unlit")) batch.lighting = false;
+			else if (!strcmp(token, "blend")) batch.blend = true;
+			else if (!strcmp(token, "main-only")) batch.insets = false;
+			else return "unknown flag";
+			continue;
+		}
+		*value++ = 0;
+		int index = 0, end = -1;
+		if (!strcmp(token, "parent")) {
+			const auto found = names.find(value);
+			if (found == names.end()) return "parent not defined before the node";
+			parent = found->second;
+		} else if (!strcmp(token, "mesh")) {
+			if ((index = lookup(meshNames, value)) < 0) return "unknown mesh";
+			batch.mesh = (sceneMesh)index;
+		} else if (!strcmp(token, "material")) {
+			if ((index = lookup(materialNames, value)) < 0) return "unknown material";
+			batch.material = index;
+		} else if (!strcmp(token, "texture")) {
+			if ((index = lookup(textureNames, value)) < 0) return "unknown texture";
+			batch.texture = index;
+		} else if (!strcmp(token, "shadow")) {
+			if ((index = lookup(shadowNames, value)) < 0) return "unknown shadow caster";
+			batch.shadow = index;
+		} else if (!strcmp(token, "bind")) {
+			char* number = strchr(value, ':');
+			if (number) *number++ = 0;
+			if ((index = lookup(bindingNames, value)) <= 0) return "unknown binding";
+			binding = (sceneBinding)index;
+			if (number && (sscanf(number, "%d%n", &channel, &end) != 1 || number[end] || channel < 0 || channel >= channels))
+				return "binding channel out of range";
+		} else if (!strcmp(token, "translate")) {
+			if (sscanf(value, "%f,%f,%f%n", &translate[0], &translate[1], &translate[2], &end) != 3 || value[end])
+				return "translate needs x,y,z";
+		} else if (!strcmp(token, "rotate")) {
+			if (sscanf(value, "%f,%f,%f,%f%n", &rotate[0], &rotate[1], &rotate[2], &rotate[3], &end) != 4 || value[end])
+				return "rotate needs degrees,x,y,z";
+		} else if (!strcmp(token, "scale")) {
+			if (sscanf(value, "%f,%f,%f%n", &scale[0], &scale[1], &scale[2], &end) != 3 || value[end])
+				return "scale needs x,y,z";
+		} else if (!strcmp(token, "color")) {
+			if (sscanf(value, "%f,%f,%f,%f%n", &color[0], &color[1], &color[2], &color[3], &end) != 4 || value[end])
+				return "color needs r,g,b,a";
+		} else return "unknown field";
+	}
+
+	int32_t batchIndex = -1;
+	if (batch.mesh != sceneMesh::none) {
+		for (size_t i = 0; i < scene.batches.size() && batchIndex < 0; i++)
+			if (!memcmp(&scene.batches[i], &batch, sizeof batch)) batchIndex = i;
+		if (batchIndex < 0) {
+			batchIndex = scene.batches.size();
+			scene.batches.push_back(batch);
+		}
+	}
+	scene.parent.push_back(parent);
+	scene.batch.push_back(batchIndex);
+	scene.binding.push_back(binding);
+	scene.channel.push_back(channel);
+	scene.translate.insert(scene.translate.end(), translate, translate + 3);
+	scene.rotate.insert(scene.rotate.end(), rotate, rotate + 4);
+	scene.scale.insert(scene.scale.end(), scale, scale + 3);
+	scene.color.insert(scene.color.end(), color, color + 4);
+	return nullptr;
+}
+
+// One node per line: "node <name>" followed by key=value fields and flags, # starts a comment
+bool parseScene(const char* source) {
+	FILE* file = fopen(source, "r");
+	if (!file) {
+		fprintf(stderr, "Unable to open file: %s\n", source);
+		return false;
+	}
+
+	clearScene();
+	std::unordered_map<std::string, int32_t> names;
+	char line[1024];
+	const char* error = nullptr;
+	for (int number = 1; !error && fgets(line, sizeof line, file); number++) {
+		if (char* comment = strchr(line, '#')) *comment = 0;
+		const char* token = strtok(line, " \t\r\n");
+		if (!token) continue;
+		const char* name = strcmp(token, "node") ? nullptr : strtok(NULL, " \t\r\n");
+		if (!name) error = "expected node <name>";
+		else if (names.count(name)) error = "node defined twice";
+		else {
+			const int32_t index = scene.parent.size();
+			error = parseNode(names);
+			names.emplace(name, index);
+		}
+		if (error) fprintf(stderr, "Unable to parse %s:%d: %s\n", source, number, error);
+	}
+	fclose(file);
+	if (error) return false;
+
+	sceneTables.count = scene.parent.size();
+	sceneTables.parent = scene.parent.data();
+	sceneTables.batch = scene.batch.data();
+	sceneTables.binding = scene.binding.data();
+	sceneTables.channel = scene.channel.data();
+	sceneTables.translate = scene.translate.data();
+	sceneTables.rotate = scene.rotate.data();
+	sceneTables.scale = scene.scale.data();
+	sceneTables.color = scene.color.data();
+	return true;
+}
+
+// Cache layout: header, batches, then one column after another, each 16-byte aligned
+struct sceneHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t nodeCount;
+	uint32_t batchCount;
+	int64_t sourceTime;
+	int64_t sourceSize;
+};
+constexpr uint32_t sceneVersion = 1;
+
+struct sceneLayout {
+	size_t batches, parent, batch, binding, channel, translate, rotate, scale, color, size;
+};
+
+sceneLayout layoutFor(size_t nodes, size_t batches) {
+	size_t end = sizeof(sceneHeader);
+	auto place = [&end](size_t bytes) {
+		const size_t start = (end + 15) & ~15;
+		end = start + bytes;
+		return start;
+	};
+	sceneLayout layout;
+	layout.batches = place(batches * sizeof(sceneBatch));
+	layout.parent = place(nodes * sizeof(int32_t));
+	layout.batch = place(nodes * sizeof(int32_t));
+	layout.binding = place(nodes * sizeof(sceneBinding));
+	layout.channel = place(nodes);
+	layout.translate = place(3 * nodes * sizeof(GLfloat));
+	layout.rotate = place(4 * nodes * sizeof(GLfloat));
+	layout.scale = place(3 * nodes * sizeof(GLfloat));
+	layout.color = place(4 * nodes * sizeof(GLfloat));
+	layout.size = end;
+	return layout;
+}
+
+std::string sceneCachePath(const char* source) {
+	return std::string(source) + ".bin";
+}
+
+// Indices and enums a corrupt or foreign cache could get wrong
+bool validScene() {
+	for (const auto& batch : scene.batches)
+		if (batch.mesh > sceneMesh::floor || batch.material >= materialCount || batch.texture > 3
+			|| batch.shadow > (uint8_t)shadowCaster::moving) return false;
+	const sceneNodes& nodes = sceneTables;
+	for (uint32_t i = 0; i < nodes.count; i++)
+		if (nodes.parent[i] < -1 || nodes.parent[i] >= (int32_t)i || nodes.batch[i] < -1
+			|| nodes.batch[i] >= (int32_t)scene.batches.size() || nodes.binding[i] > sceneBinding::eq
+			|| nodes.channel[i] >= channels) return false;
+	return true;
+}
+
+// Maps a valid cache file, the node tables point straight into it
+bool loadSceneCache(const char* source) {
+	int64_t time, size;
+	if (!sourceStamp(source, &time, &size)) return false;
+
+	const int fd = open(sceneCachePath(source).c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	void* mapping = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(sceneHeader))
+		mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return false;
+
+	const unsigned char* bytes = (const unsigned char*)mapping;
+	const sceneHeader* header = (const sceneHeader*)bytes;
+	const sceneLayout layout = layoutFor(header->nodeCount, header->batchCount);
+	if (memcmp(header->magic, "SCNC", 4) || header->version != sceneVersion
+		|| header->sourceTime != time || header->sourceSize != size || layout.size != (size_t)st.st_size) {
+		munmap(mapping, st.st_size);
+		return false;
+	}
+
+	clearScene();
+	const sceneBatch* batches = (const sceneBatch*)(bytes + layout.batches);
+	scene.batches.assign(batches, batches + header->batchCount);
+	scene.mapping = mapping;
+	scene.mappingSize = st.st_size;
+	sceneTables.count = header->nodeCount;
+	sceneTables.parent = (const int32_t*)(bytes + layout.parent);
+	sceneTables.batch = (const int32_t*)(bytes + layout.batch);
+	sceneTables.binding = (const sceneBinding*)(bytes + layout.binding);
+	sceneTables.channel = bytes + layout.channel;
+	sceneTables.translate = (const GLfloat*)(bytes + layout.translate);
+	sceneTables.rotate = (const GLfloat*)(bytes + layout.rotate);
+	sceneTables.scale = (const GLfloat*)(bytes + layout.scale);
+	sceneTables.color = (const GLfloat*)(bytes + layout.color);
+	if (validScene()) return true;
+	clearScene();
+	return false;
+}
+
+// Writes to a temporary file and renames it, so readers never see a partial cache
+void saveSceneCache(const char* source) {
+	const sceneNodes& nodes = sceneTables;
+	sceneHeader header = {};
+	memcpy(header.magic, "SCNC", 4);
+	header.version = sceneVersion;
+	header.nodeCount = nodes.count;
+	header.batchCount = scene.batches.size();
+	if (!sourceStamp(source, &header.sourceTime, &header.sourceSize)) return;
+
+	const sceneLayout layout = layoutFor(nodes.count, scene.batches.size());
+	std::vector<unsigned char> bytes(layout.size);
+	auto copy = [&bytes](size_t offset, const void* column, size_t size) {
+		if (size) memcpy(bytes.data() + offset, column, size);
+	};
+	copy(0, &header, sizeof header);
+	copy(layout.batches, scene.batches.data(), scene.batches.size() * sizeof(sceneBatch));
+	copy(layout.parent, nodes.parent, nodes.count * sizeof(int32_t));
+	copy(layout.batch, nodes.batch, nodes.count * sizeof(int32_t));
+	copy(layout.binding, nodes.binding, nodes.count * sizeof(sceneBinding));
+	copy(layout.channel, nodes.channel, nodes.count);
+	copy(layout.translate, nodes.translate, 3 * nodes.count * sizeof(GLfloat));
+	copy(layout.rotate, nodes.rotate, 4 * nodes.count * sizeof(GLfloat));
+	copy(layout.scale, nodes.scale, 3 * nodes.count * sizeof(GLfloat));
+	copy(layout.color, nodes.color, 4 * nodes.count * sizeof(GLfloat));
+
+	const std::string path = sceneCachePath(source), temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file) return;
+	bool ok = fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	ok = !fclose(file) && ok;
+	if (!ok || rename(temp.c_str(), path.c_str())) remove(temp.c_str());
+}
+
+bool loadScene(const char* source) {
+	if (!loadSceneCache(source)) {
+		if (!parseScene(source)) return false;
+		saveSceneCache(source);
+	}
+
+	scene.instances.clear();
+	for (const auto& batch : scene.batches) {
+		instanceBatch instances = { meshShapes[(int)batch.mesh], (materials)batch.material };
+		instances.lighting = batch.lighting;
+		instances.blend = batch.blend;
+		instances.texture = textureRegions[batch.texture];
+		instances.insets = batch.insets;
+		instances.shadow = (shadowCaster)batch.shadow;
+		instances.bounds = meshBounds[(int)batch.mesh];
+		scene.instances.push_back(instances);
+	}
+	const sceneNodes& nodes = sceneTables;
+	scene.bound.clear();
+	scene.colors.assign(nodes.color, nodes.color + 4 * nodes.count);
+	scene.visible.resize(nodes.count);
+	scene.boxes.resize(nodes.count);
+	scene.animated.resize(nodes.count);
+	scene.indexed = false;
+	resetTransforms(nodes.parent, nodes.count);
+	for (uint32_t i = 0; i < nodes.count; i++) {
+		setLocal(i, nodes.translate + 3 * i, nodes.rotate + 4 * i, nodes.scale + 3 * i);
+		if (nodes.binding[i] != sceneBinding::none) scene.bound.push_back(i);
+		scene.animated[i] = nodes.binding[i] != sceneBinding::none || (nodes.parent[i] >= 0 && scene.animated[nodes.parent[i]]);
+	}
+	return true;
+}
+
+// Builds the index over the visible meshes, only those in the still or moving part
+void indexNodes(bvh* tree, GLboolean animated) {
+	const sceneNodes& nodes = sceneTables;
+	std::vector<uint32_t> ids;
+	for (uint32_t i = 0; i < nodes.count; i++)
+		if (nodes.batch[i] >= 0 && scene.visible[i] && scene.animated[i] == animated) ids.push_back(i);
+	buildBvh(tree, scene.boxes.data(), ids.data(), ids.size());
+}
+
+// Only bound nodes get a new local transform, the hierarchy then rebuilds the world
+// matrices of the ones that actually moved and of their children. The still part of
+// the index is built once, the moving one refit in place unless a part was shown or hidden.
+void recordNodes(const mixerSettings* settings, const bars* eq) {
+	const sceneNodes& nodes = sceneTables;
+	for (uint32_t i : scene.bound) {
+		GLfloat translate[3], rotate[4], scale[3];
+		memcpy(translate, nodes.translate + 3 * i, sizeof translate);
+		memcpy(rotate, nodes.rotate + 4 * i, sizeof rotate);
+		memcpy(scale, nodes.scale + 3 * i, sizeof scale);
+		const int channel = nodes.channel[i];
+		switch (nodes.binding[i]) {
+		case sceneBinding::knob:
+			rotate[0] += settings->knob[channel];
+			break;
+		case sceneBinding::button:
+			translate[1] += settings->button[channel];
+			break;
+		case sceneBinding::slider:
+			translate[2] += settings->slider;
+			break;
+		case sceneBinding::eq:
+			scale[2] *= eq->bar[channel];
+			break;
+		default:
+			break;
+		}
+		setLocal(i, translate, rotate, scale);
+	}
+	updateTransforms();
+
+	GLboolean moved = false, shownOrHidden = false;
+	for (uint32_t i = 0; i < nodes.count; i++) {
+		const int32_t parent = nodes.parent[i];
+		GLboolean visible = parent < 0 || scene.visible[parent];
+		if (nodes.binding[i] == sceneBinding::eq) visible = visible && settings->pressed[nodes.channel[i]];
+		const GLboolean shown = visible && !scene.visible[i];
+		if (nodes.batch[i] >= 0 && visible != scene.visible[i]) {
+			shownOrHidden = true;
+			markCasters(scene.instances[nodes.batch[i]].shadow);
+		}
+		scene.visible[i] = visible;
+		if (!visible || nodes.batch[i] < 0) continue;
+
+		const instanceBatch* batch = &scene.instances[nodes.batch[i]];
+		if (worldRebuilt(i)) markCasters(batch->shadow);
+		if (worldRebuilt(i) || shown) {
+			scene.boxes[i] = transformBounds(toMat4(worldMatrix(i)), *batch->bounds);
+			moved = moved || scene.animated[i];
+		}
+		addInstance(batch, worldMatrix(i), worldNormal(i), &scene.colors[4 * i], &scene.boxes[i], i);
+	}
+
+	if (!scene.indexed) {
+		indexNodes(&scene.still, false);
+		indexNodes(&scene.moving, true);
+		setCullingIndex({ &scene.still, &scene.moving }, nodes.count);
+		scene.indexed = true;
+	} else if (shownOrHidden) {
+		indexNodes(&scene.moving, true);
+	} else if (moved) {
+		refitBvh(&scene.moving, scene.boxes.data());
+	}
+}
+
+int32_t pickNode(vec3 origin, vec3 direction) {
+	float distance = INFINITY;
+	uint32_t node = 0;
+	bool hit = rayQuery(scene.still, origin, direction, &distance, &node);
+	hit = rayQuery(scene.moving, origin, direction, &distance, &node) || hit;
+	return hit ? node : -1;
+}
\ No newline at end of file
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "include/shaders.h"
+#include "include/materials.h"
+
+// Compatibility profile keeps the fixed-function matrix stacks and vertex arrays. The
+// modelview holds the view only, each instance brings its model and normal matrices.
+const char* vertexSource = R"(#version 150 compatibility
+in mat4 instanceModel;
+in mat3 instanceNormal;
+in vec4 instanceColor;
+
+out vec3 worldPosition;
+out vec3 worldNormal;
+out vec2 texCoord;
+out vec4 color;
+out float viewDepth;
+
+void main() {
+	vec4 world = instanceModel * gl_Vertex;
+	worldPosition = world.xyz;
+	viewDepth = -(gl_ModelViewMatrix * world).z;
+	worldNormal = instanceNormal * gl_Normal;
+	texCoord = (gl_TextureMatrix[0] * gl_MultiTexCoord0).xy;
+	color = instanceColor;
+	gl_Position = gl_ModelViewProjectionMatrix * world;
+}
+)";
+
+// Shadow casters only need their depth
+const char* casterVertexSource = R"(#version 150 compatibility
+in mat4 instanceModel;
+
+void main() {
+	gl_Position = gl_ModelViewProjectionMatrix * (instanceModel * gl_Vertex);
+}
+)";
+
+const char* casterFragmentSource = R"(#version 150 compatibility
+void main() {
+}
+)";
+
+// Same terms as the fixed-function light equation, evaluated per pixel with a Blinn-Phong half
+// vector. Ranged lights fade out smoothly at their range, which is what clustering culls against.
+// Shadows only darken the diffuse and specular terms, and are skipped where those are zero.
+const char* fragmentSource = R"(
+struct lightSource {
+	vec4 position;
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	vec4 spot;
+	vec4 params;
+};
+
+layout(std140) uniform lights {
+	vec4 globalAmbient;
+	int lightCount;
+	int shadowFilter;
+	mat4 spotShadowMatrix;
+	vec4 shadowPlanes;	// Point map near and far planes
+	lightSource sources[MAX_LIGHTS];
+};
+
+struct surface {
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+};
+
+layout(std140) uniform materials {
+	surface table[MATERIALS];
+};
+
+uniform int material;
+uniform bool lit;
+uniform bool textured;
+uniform sampler2D atlas;
+uniform sampler2DShadow spotShadow;
+uniform samplerCubeShadow pointShadow;
+uniform vec4 eye;
+
+in vec3 worldPosition;
+in vec3 worldNormal;
+in vec2 texCoord;
+in vec4 color;
+in float viewDepth;
+
+out vec4 fragColor;
+
+#if CLUSTERED
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusters;
+uniform usamplerBuffer lightIndices;
+uniform vec4 clusterViewport;	// x, y, width, height
+uniform vec4 clusterDepth;		// near, far, slice scale, 1 when orthographic
+
+lightSource fetchLight(int i) {
+	lightSource s;
+	s.position = texelFetch(lightData, 6 * i);
+	s.ambient = texelFetch(lightData, 6 * i + 1);
+	s.diffuse = texelFetch(lightData, 6 * i + 2);
+	s.specular = texelFetch(lightData, 6 * i + 3);
+	s.spot = texelFetch(lightData, 6 * i + 4);
+	s.params = texelFetch(lightData, 6 * i + 5);
+	return s;
+}
+#endif
+
+#if SHADOWS
+// Fraction of the spot map lit at this fragment. Each compare is already bilinear,
+// so PCF takes four of them a texel apart.
+float spotVisibility(vec3 position) {
+	vec4 p = spotShadowMatrix * vec4(position, 1.0);
+	if (p.w <= 0.0) return 1.0;
+	p.xyz /= p.w;
+#if SHADOWS == 1
+	return texture(spotShadow, p.xyz);
+#else
+	vec2 texel = 1.0 / vec2(textureSize(spotShadow, 0));
+	float sum = 0.0;
+	for (int i = 0; i < 4; i++) {
+		vec2 offset = vec2(i & 1, i >> 1) - 0.5;
+		sum += texture(spotShadow, vec3(p.xy + offset * 2.0 * texel, p.z));
+	}
+	return sum / 4.0;
+#endif
+}
+
+// The cube face depth is the perspective depth of the major axis distance,
+// PCF takes four taps on a tetrahedron around the lookup direction
+float pointVisibility(vec3 position, vec3 lightPosition) {
+	vec3 d = position - lightPosition;
+	vec3 a = abs(d);
+	float z = max(a.x, max(a.y, a.z));
+	float near = shadowPlanes.x, far = shadowPlanes.y;
+	float depth = 0.5 * ((far + near) / (far - near) - 2.0 * far * near / ((far - near) * z)) + 0.5;
+#if SHADOWS == 1
+	return texture(pointShadow, vec4(d, depth));
+#else
+	const vec3 offsets[4] = vec3[](vec3(1, 1, 1), vec3(1, -1, -1), vec3(-1, 1, -1), vec3(-1, -1, 1));
+	float r = 0.004 * z;	// About a texel of a 512 face
+	float sum = 0.0;
+	for (int i = 0; i < 4; i++) sum += texture(pointShadow, vec4(d + offsets[i] * r, depth));
+	return sum / 4.0;
+#endif
+}
+
+// Looked up slightly off the surface along its normal, against acne at grazing angles
+const float shadowOffset = 0.004;
+#endif
+
+float visibility(lightSource s, vec3 n) {
+#if SHADOWS
+	if (s.params.z == 0.0) return 1.0;
+	vec3 position = worldPosition + n * shadowOffset * distance(worldPosition, s.position.xyz);
+	return s.params.z == 1.0 ? spotVisibility(position) : pointVisibility(position, s.position.xyz);
+#else
+	return 1.0;
+#endif
+}
+
+vec3 shade(lightSource s, surface m, vec3 n, vec3 v) {
+	vec3 toLight = s.position.xyz - worldPosition * s.position.w;
+	vec3 l = normalize(toLight);
+	float factor = 1.0;
+	if (s.params.y > 0.0) {
+		float d = length(toLight) / s.params.y;
+		factor = clamp(1.0 - d * d, 0.0, 1.0);
+		factor *= factor;
+	}
+	if (s.spot.w > -1.0) {
+		float c = dot(-l, s.spot.xyz);
+		factor *= c >= s.spot.w ? pow(max(c, 0.0), s.params.x) : 0.0;
+	}
+	float diffuse = max(dot(n, l), 0.0);
+	if (diffuse == 0.0 || factor == 0.0) return factor * s.ambient.rgb * m.ambient.rgb;
+	vec3 term = diffuse * s.diffuse.rgb * m.diffuse.rgb
+		+ pow(max(dot(n, normalize(l + v)), 0.0), m.specular.w) * s.specular.rgb * m.specular.rgb;
+	return factor * (s.ambient.rgb * m.ambient.rgb + visibility(s, n) * term);
+}
+
+void main() {
+	vec4 base = color;
+	if (lit) {
+		surface m = table[material];
+		vec3 n = normalize(worldNormal);
+		vec3 v = normalize(eye.xyz - worldPosition * eye.w);
+		vec3 sum = globalAmbient.rgb * m.ambient.rgb;
+#if CLUSTERED
+		ivec2 tile = ivec2((gl_FragCoord.xy - clusterViewport.xy) / clusterViewport.zw * vec2(CLUSTER_X, CLUSTER_Y));
+		tile = clamp(tile, ivec2(0), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+		float depth = clusterDepth.w > 0.0 ? (viewDepth - clusterDepth.x) * clusterDepth.z
+			: log(max(viewDepth, clusterDepth.x) / clusterDepth.x) * clusterDepth.z;
+		int slice = clamp(int(depth), 0, CLUSTER_Z - 1);
+		uvec2 range = texelFetch(clusters, (slice * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x).xy;
+		for (uint k = 0u; k < range.y; k++)
+			sum += shade(fetchLight(int(texelFetch(lightIndices, int(range.x + k)).x)), m, n, v);
+#else
+		for (int i = 0; i < LIGHTS; i++) sum += shade(sources[i], m, n, v);
+#endif
+		base = vec4(clamp(sum, 0.0, 1.0), m.diffuse.a);
+	}
+	if (textured) base *= texture(atlas, texCoord);
+	fragColor = base;
+}
+)";
+
+enum binding : GLuint { lightsBinding, materialsBinding };
+
+// One program per light count and shadow filter: the light loop has a constant bound and
+// the shadow lookups are compiled out when off, which software rasterisers run far faster
+// than branches on uniforms. Light count -1 is the clustered program.
+struct program {
+	GLuint id = 0;
+	GLint material, lit, textured, eye;
+	GLint clusterViewport, clusterDepth;
+};
+constexpr GLint clusteredKey = -1;
+
+struct {
+	std::map<std::pair<GLint, GLint>, program> programs;
+	program* current = nullptr;
+	GLuint casters = 0;
+	GLint materialCount = 0;
+	GLuint lights = 0, materials = 0;
+	GLint boundMaterial = -1, boundLit = -1, boundTextured = -1;
+	GLfloat clusterViewport[4] = {}, clusterDepth[4] = {};	// Applied when the program is bound
+} shaders;
+
+GLuint compileShader(GLenum type, const char* source) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+	GLint ok = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[BUFSIZ];
+		glGetShaderInfoLog(shader, sizeof log, NULL, log);
+		fprintf(stderr, "Unable to compile %s shader:\n%s\n", type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+// Links the two stages with the instance attributes at their fixed locations, 0 on failure
+GLuint linkProgram(GLuint vertexShader, GLuint fragmentShader) {
+	if (!vertexShader || !fragmentShader) return 0;
+	GLuint id = glCreateProgram();
+	glAttachShader(id, vertexShader);
+	glAttachShader(id, fragmentShader);
+	glBindAttribLocation(id, modelAttribute, "instanceModel");
+	glBindAttribLocation(id, normalAttribute, "instanceNormal");
+	glBindAttribLocation(id, colorAttribute, "instanceColor");
+	glLinkProgram(id);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	GLint ok = 0;
+	glGetProgramiv(id, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		char log[BUFSIZ];
+		glGetProgramInfoLog(id, sizeof log, NULL, log);
+		fprintf(stderr, "Unable to link shaders:\n%s\n", log);
+		glDeleteProgram(id);
+		return 0;
+	}
+	return id;
+}
+
+// Compiles and links the variant for a light count (or clusteredKey) and shadow filter,
+// or returns the cached one
+program* programFor(GLint lights, GLint shadows) {
+	auto cached = shaders.programs.find({ lights, shadows });
+	if (cached != shaders.programs.end()) return cached->second.id ? &cached->second : nullptr;
+
+	program& p = shaders.programs[{ lights, shadows }];
+	const std::string fragment = "#version 150 compatibility\n#define MAX_LIGHTS " + std::to_string(maxLights)
+		+ "\n#define LIGHTS " + std::to_string(std::max(lights, 0))
+		+ "\n#define CLUSTERED " + std::to_string(lights == clusteredKey)
+		+ "\n#define SHADOWS " + std::to_string(shadows)
+		+ "\n#define CLUSTER_X " + std::to_string(clusterX) + "\n#define CLUSTER_Y " + std::to_string(clusterY)
+		+ "\n#define CLUSTER_Z " + std::to_string(clusterZ)
+		+ "\n#define MATERIALS " + std::to_string(shaders.materialCount) + "\n" + fragmentSource;
+	GLuint id = linkProgram(compileShader(GL_VERTEX_SHADER, vertexSource),
+							compileShader(GL_FRAGMENT_SHADER, fragment.c_str()));
+	if (!id) return nullptr;
+
+	p.id = id;
+	p.material = glGetUniformLocation(id, "material");
+	p.lit = glGetUniformLocation(id, "lit");
+	p.textured = glGetUniformLocation(id, "textured");
+	p.eye = glGetUniformLocation(id, "eye");
+	p.clusterViewport = glGetUniformLocation(id, "clusterViewport");
+	p.clusterDepth = glGetUniformLocation(id, "clusterDepth");
+	glUniformBlockBinding(id, glGetUniformBlockIndex(id, "lights"), lightsBinding);
+	glUniformBlockBinding(id, glGetUniformBlockIndex(id, "materials"), materialsBinding);
+	// Sampler units are set once, with the program bound (glProgramUniform needs GL 4.1)
+	GLint previous = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+	glUseProgram(id);
+	glUniform1i(glGetUniformLocation(id, "atlas"), atlasUnit);
+	glUniform1i(glGetUniformLocation(id, "lightData"), lightUnit);
+	glUniform1i(glGetUniformLocation(id, "clusters"), clusterUnit);
+	glUniform1i(glGetUniformLocation(id, "lightIndices"), indexUnit);
+	glUniform1i(glGetUniformLocation(id, "spotShadow"), spotShadowUnit);
+	glUniform1i(glGetUniformLocation(id, "pointShadow"), pointShadowUnit);
+	glUseProgram(previous);
+	return &p;
+}
+
+// Creates the uniform buffers, uploads the material table once and builds the unlit and caster programs
+bool initShaders(const shaderMaterial* table, int count) {
+	shaders.materialCount = count;
+	glGenBuffers(1, &shaders.lights);
+	glBindBuffer(GL_UNIFORM_BUFFER, shaders.lights);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(lightBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, lightsBinding, shaders.lights);
+
+	glGenBuffers(1, &shaders.materials);
+	glBindBuffer(GL_UNIFORM_BUFFER, shaders.materials);
+	glBufferData(GL_UNIFORM_BUFFER, count * sizeof(shaderMaterial), table, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, materialsBinding, shaders.materials);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	shaders.casters = linkProgram(compileShader(GL_VERTEX_SHADER, casterVertexSource),
+								  compileShader(GL_FRAGMENT_SHADER, casterFragmentSource));
+	shaders.current = programFor(0, noShadows);
+	return shaders.current != nullptr && shaders.casters;
+}
+
+// Per-draw uniforms are cached like the rest of the GL state, rebinding forgets them
+void useShaders(bool enable) {
+	glUseProgram(enable ? shaders.current->id : 0);
+	shaders.boundMaterial = shaders.boundLit = shaders.boundTextured = -1;
+	if (!enable) return;
+	glUniform4fv(shaders.current->clusterViewport, 1, shaders.clusterViewport);
+	glUniform4fv(shaders.current->clusterDepth, 1, shaders.clusterDepth);
+}
+
+void useCasterShader(bool enable) {
+	glUseProgram(enable ? shaders.casters : 0);
+}
+
+// Also switches to the program variant for the new light count and shadow filter
+void setLights(const lightBlock& block, bool clustered) {
+	glBindBuffer(GL_UNIFORM_BUFFER, shaders.lights);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof block, &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	if (program* p = programFor(clustered ? clusteredKey : block.count, block.shadows)) shaders.current = p;
+}
+
+void setClusterView(const GLfloat* viewport, const GLfloat* depth) {
+	std::copy(viewport, viewport + 4, shaders.clusterViewport);
+	std::copy(depth, depth + 4, shaders.clusterDepth);
+}
+
+// Sets an int uniform unless it already holds the value
+void setCached(GLint location, GLint* bound, GLint value) {
+	if (*bound == value) {
+		stateChanges.skipped++;
+		return;
+	}
+	glUniform1i(location, value);
+	*bound = value;
+	stateChanges.issued++;
+}
+
+void setShading(GLboolean lighting, GLboolean textured) {
+	setCached(shaders.current->lit, &shaders.boundLit, lighting);
+	setCached(shaders.current->textured, &shaders.boundTextured, textured);
+}
+
+void setMaterial(GLint material) {
+	setCached(shaders.current->material, &shaders.boundMaterial, material);
+}
+
+void setEye(const GLfloat* eye) {
+	glUniform4fv(shaders.current->eye, 1, eye);
+}
\ No newline at end of file
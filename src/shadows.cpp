@@ -0,0 +1,191 @@
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "include/shadows.h"
+#include "include/instancing.h"
+#include "include/textures.h"
+#include "include/vecmath.h"
+
+constexpr GLsizei spotSize = 1024, pointSize = 512;
+constexpr GLfloat shadowNear = 0.5, shadowFar = 40;
+
+shadowSettings shadowOptions;
+
+// Static casters are cached in one depth texture per light, the moving ones are
+// drawn over a copy of it so the full map never has to be rebuilt for a button press
+struct depthMap {
+	GLenum target;
+	GLsizei size;
+	GLint faces;
+	GLuint still = 0, full = 0;	// Static casters only, static and moving casters
+	bool active = false;
+	GLfloat position[3] = {};
+	GLfloat direction[3] = {};
+	GLfloat fov = 90;
+};
+
+struct {
+	depthMap spot = { GL_TEXTURE_2D, spotSize, 1 };
+	depthMap point = { GL_TEXTURE_CUBE_MAP, pointSize, 6 };
+	GLuint framebuffer = 0;
+	bool copyImage = false;	// GL 4.3 or ARB_copy_image, the still map is redrawn into the full one otherwise
+	bool stale = true;
+	GLfloat spotMatrix[16];	// World to spot map coordinates
+	shadowCounters counters;
+} shadowCache;
+
+// Cube faces in GL order: view direction and up vector
+const GLfloat cubeFaces[6][2][3] = {
+	{ { 1, 0, 0 }, { 0, -1, 0 } },
+	{ { -1, 0, 0 }, { 0, -1, 0 } },
+	{ { 0, 1, 0 }, { 0, 0, 1 } },
+	{ { 0, -1, 0 }, { 0, 0, -1 } },
+	{ { 0, 0, 1 }, { 0, -1, 0 } },
+	{ { 0, 0, -1 }, { 0, -1, 0 } }
+};
+
+// Depth texture compared in the shaders, linear filtering gives 2x2 PCF per tap
+GLuint depthTexture(const depthMap& map) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(map.target, texture);
+	for (int f = 0; f < map.faces; f++)
+		glTexImage2D(map.faces > 1 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f : map.target, 0, GL_DEPTH_COMPONENT24,
+					 map.size, map.size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(map.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(map.target, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(map.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(map.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(map.target, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(map.target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	return texture;
+}
+
+// The full maps stay bound to their texture units. Headless runs have their
+// offscreen framebuffer bound already, so it is restored afterwards.
+void initShadows() {
+	GLint previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+	glGenFramebuffers(1, &shadowCache.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowCache.framebuffer);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	shadowCache.copyImage = major > 4 || (major == 4 && minor >= 3) || hasExtension("GL_ARB_copy_image");
+
+	glActiveTexture(GL_TEXTURE0 + spotShadowUnit);
+	shadowCache.spot.still = depthTexture(shadowCache.spot);
+	shadowCache.spot.full = depthTexture(shadowCache.spot);
+	glActiveTexture(GL_TEXTURE0 + pointShadowUnit);
+	shadowCache.point.still = depthTexture(shadowCache.point);
+	shadowCache.point.full = depthTexture(shadowCache.point);
+	glActiveTexture(GL_TEXTURE0 + atlasUnit);
+}
+
+mat4 lookFrom(const GLfloat* eye, const GLfloat* direction, const GLfloat* up) {
+	const vec3 from = { eye[0], eye[1], eye[2] };
+	return lookAt(from, from + vec3{ direction[0], direction[1], direction[2] }, { up[0], up[1], up[2] });
+}
+
+// Up vector for a spot direction, avoiding one parallel to it
+const GLfloat* spotUp(const GLfloat* direction) {
+	static const GLfloat y[3] = { 0, 1, 0 }, z[3] = { 0, 0, 1 };
+	const GLfloat length = sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+	return fabs(direction[1]) > 0.99 * length ? z : y;
+}
+
+// Only invalidates the cache when a map actually moves or appears
+void placeShadows(const GLfloat* spot, const GLfloat* direction, GLfloat cutoff, const GLfloat* point) {
+	depthMap& s = shadowCache.spot;
+	depthMap& p = shadowCache.point;
+	const GLfloat fov = 2 * cutoff + 10;
+	bool moved = s.active != (spot != nullptr) || p.active != (point != nullptr);
+	if (spot) {
+		moved |= memcmp(s.position, spot, sizeof s.position) || memcmp(s.direction, direction, sizeof s.direction)
+			|| s.fov != fov;
+		memcpy(s.position, spot, sizeof s.position);
+		memcpy(s.direction, direction, sizeof s.direction);
+		s.fov = fov;
+	}
+	if (point) {
+		moved |= memcmp(p.position, point, sizeof p.position) != 0;
+		memcpy(p.position, point, sizeof p.position);
+	}
+	s.active = spot != nullptr;
+	p.active = point != nullptr;
+	if (!moved) return;
+	shadowCache.stale = true;
+
+	// Bias maps clip space to texture space
+	const mat4 bias = { { 0.5, 0, 0, 0, 0, 0.5, 0, 0, 0, 0, 0.5, 0, 0.5, 0.5, 0.5, 1 } };
+	const mat4 spotMatrix = bias * perspective(s.fov, 1, shadowNear, shadowFar)
+		* lookFrom(s.position, s.direction, spotUp(s.direction));
+	memcpy(shadowCache.spotMatrix, spotMatrix.m, sizeof shadowCache.spotMatrix);
+}
+
+void shadowUniforms(lightBlock* block) {
+	memcpy(block->spotShadow, shadowCache.spotMatrix, sizeof block->spotShadow);
+	block->shadows = !shadowOptions.enabled ? noShadows : shadowOptions.pcf ? pcfShadows : singleTapShadows;
+	block->shadowPlanes[0] = shadowNear;
+	block->shadowPlanes[1] = shadowFar;
+}
+
+// Draws one kind of caster into every face of a map
+void drawMap(const depthMap& map, GLuint texture, shadowCaster kind, bool clear) {
+	const mat4 projection = perspective(map.fov, 1, shadowNear, shadowFar);
+	const lodView lod = lodFor(projection.m, map.size);
+	glViewport(0, 0, map.size, map.size);
+	glMatrixMode(GL_PROJECTION);
+	glLoadMatrixf(projection.m);
+	glMatrixMode(GL_MODELVIEW);
+	for (int f = 0; f < map.faces; f++) {
+		const GLenum target = map.faces > 1 ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + f : map.target;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, target, texture, 0);
+		if (clear) glClear(GL_DEPTH_BUFFER_BIT);
+		const mat4 view = map.faces > 1 ? lookFrom(map.position, cubeFaces[f][0], cubeFaces[f][1])
+			: lookFrom(map.position, map.direction, spotUp(map.direction));
+		drawCasters(kind, view.m, lod);
+	}
+}
+
+// Static casters are redrawn when they or the lights change, moving casters whenever
+// any of them changed; an idle scene draws nothing here. Changes come from the
+// recorders, so nothing is compared per caster.
+void renderShadows() {
+	if (!shadowOptions.enabled || (!shadowCache.spot.active && !shadowCache.point.active)) return;
+	const bool redrawStill = shadowCache.stale || castersChanged(shadowCaster::still);
+	if (!redrawStill && !castersChanged(shadowCaster::moving)) return;
+
+	GLint previous = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_FRAMEBUFFER, shadowCache.framebuffer);
+	bindRegion(nullptr);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2, 4);
+	for (depthMap* map : { &shadowCache.spot, &shadowCache.point }) {
+		if (!map->active) continue;
+		if (shadowCache.copyImage) {
+			if (redrawStill) drawMap(*map, map->still, shadowCaster::still, true);
+			glCopyImageSubData(map->still, map->target, 0, 0, 0, 0, map->full, map->target, 0, 0, 0, 0,
+							   map->size, map->size, map->faces);
+		} else {
+			drawMap(*map, map->full, shadowCaster::still, true);
+		}
+		drawMap(*map, map->full, shadowCaster::moving, false);
+	}
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+	if (redrawStill || !shadowCache.copyImage) shadowCache.counters.still++;
+	shadowCache.counters.moving++;
+	clearCasterChanges();
+	shadowCache.stale = false;
+}
+
+shadowCounters shadowStatistics() {
+	return shadowCache.counters;
+}
\ No newline at end of file
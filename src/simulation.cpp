@@ -0,0 +1,25 @@
+#include <algorithm>
+
+#include "include/simulation.h"
+
+struct {
+	double accumulator = 0;
+	long long steps = 0;
+} simulation;
+
+int advanceClock(double seconds, int maxSteps) {
+	simulation.accumulator += std::max(seconds, 0.0);
+	int steps = (int)(simulation.accumulator / simulationStep);
+	simulation.accumulator -= steps * simulationStep;
+	if (steps > maxSteps) steps = maxSteps;
+	simulation.steps += steps;
+	return steps;
+}
+
+double stepFraction() {
+	return std::min(simulation.accumulator / simulationStep, 1.0);
+}
+
+double simulationTime() {
+	return simulation.steps * simulationStep;
+}
\ No newline at end of file
@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "include/texturedata.h"
+
+size_t rowBytes(GLsizei width) {
+	return (3 * width + 3) & ~3;
+}
+
+// 2x2 box filter, edge texels are repeated for odd sizes
+void downsample(const unsigned char* src, GLsizei width, GLsizei height,
+				unsigned char* dst, GLsizei dstWidth, GLsizei dstHeight) {
+	const size_t srcStride = rowBytes(width), dstStride = rowBytes(dstWidth);
+	for (GLsizei y = 0; y < dstHeight; y++) {
+		const unsigned char* row0 = src + std::min(2 * y, height - 1) * srcStride;
+		const unsigned char* row1 = src + std::min(2 * y + 1, height - 1) * srcStride;
+		unsigned char* out = dst + y * dstStride;
+		for (GLsizei x = 0; x < dstWidth; x++) {
+			const GLsizei x0 = 3 * std::min(2 * x, width - 1), x1 = 3 * std::min(2 * x + 1, width - 1);
+			for (int c = 0; c < 3; c++)
+				out[3 * x + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4;
+		}
+	}
+}
+
+GLushort to565(const int* c) {
+	return ((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3);
+}
+
+void from565(GLushort v, int* c) {
+	c[0] = (v >> 11) * 255 / 31;
+	c[1] = ((v >> 5) & 63) * 255 / 63;
+	c[2] = (v & 31) * 255 / 31;
+}
+
+// DXT1 (BC1) encoder: bounding box endpoints, each texel takes the nearest palette colour
+void compressDxt1(const unsigned char* rgb, GLsizei width, GLsizei height, std::vector<unsigned char>* out) {
+	const size_t stride = rowBytes(width);
+	for (GLsizei by = 0; by < height; by += 4)
+		for (GLsizei bx = 0; bx < width; bx += 4) {
+			int block[16][3], lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+			for (int i = 0; i < 16; i++) {
+				const unsigned char* p = rgb + std::min(by + i / 4, height - 1) * stride
+					+ 3 * std::min(bx + i % 4, width - 1);
+				for (int c = 0; c < 3; c++) {
+					block[i][c] = p[c];
+					lo[c] = std::min(lo[c], block[i][c]);
+					hi[c] = std::max(hi[c], block[i][c]);
+				}
+			}
+
+			// c0 > c1 selects the four colour mode
+			GLushort c0 = to565(hi), c1 = to565(lo);
+			if (c0 < c1) std::swap(c0, c1);
+			GLuint indices = 0;
+			if (c0 != c1) {
+				int palette[4][3];
+				from565(c0, palette[0]);
+				from565(c1, palette[1]);
+				for (int c = 0; c < 3; c++) {
+					palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+					palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+				}
+				for (int i = 0; i < 16; i++) {
+					int best = 0, bestDistance = INT_MAX;
+					for (int k = 0; k < 4; k++) {
+						int distance = 0;
+						for (int c = 0; c < 3; c++)
+							distance += (block[i][c] - palette[k][c]) * (block[i][c] - palette[k][c]);
+						if (distance < bestDistance) {
+							bestDistance = distance;
+							best = k;
+						}
+					}
+					indices |= best << (2 * i);
+				}
+			}
+
+			const unsigned char bytes[8] = {
+				(unsigned char)c0, (unsigned char)(c0 >> 8),
+				(unsigned char)c1, (unsigned char)(c1 >> 8),
+				(unsigned char)indices, (unsigned char)(indices >> 8),
+				(unsigned char)(indices >> 16), (unsigned char)(indices >> 24)
+			};
+			out->insert(out->end(), bytes, bytes + 8);
+		}
+}
+
+// Builds the full mip chain down to 1x1, optionally DXT1 compressed
+void buildTextureData(const RgbImage& image, bool compress, textureData* data) {
+	GLsizei width = image.GetNumCols(), height = image.GetNumRows();
+	const unsigned char* pixels = (const unsigned char*)image.ImageData();
+	std::vector<unsigned char> level(pixels, pixels + height * rowBytes(width)), next;
+
+	data->format = compress ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB;
+	data->levels.clear();
+	data->pixels.clear();
+	for (;;) {
+		mipLevel mip = { width, height, data->pixels.size(), 0 };
+		if (compress) compressDxt1(level.data(), width, height, &data->pixels);
+		else data->pixels.insert(data->pixels.end(), level.begin(), level.end());
+		mip.size = data->pixels.size() - mip.offset;
+		data->levels.push_back(mip);
+		if (width == 1 && height == 1) break;
+
+		const GLsizei nextWidth = std::max(1, width / 2), nextHeight = std::max(1, height / 2);
+		next.resize(nextHeight * rowBytes(nextWidth));
+		downsample(level.data(), width, height, next.data(), nextWidth, nextHeight);
+		level.swap(next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
+
+const unsigned char* texturePixels(const textureData& data) {
+	return data.mapped ? data.mapped : data.pixels.data();
+}
+
+void freeTextureData(textureData* data) {
+	if (data->mapping) munmap(data->mapping, data->mappingSize);
+	*data = textureData();
+}
+
+// Level layout in copy units: texels for GL_RGB, 4x4 blocks for DXT1
+struct unitGrid {
+	GLsizei columns, rows;
+	size_t unitBytes, stride;
+};
+
+unitGrid levelGrid(GLenum format, GLsizei width, GLsizei height) {
+	if (format == GL_RGB) return { width, height, 3, rowBytes(width) };
+	const GLsizei columns = (width + 3) / 4;
+	return { columns, (height + 3) / 4, 8, (size_t)columns * 8 };
+}
+
+// Cache layout: header, levelCount mipLevels, rectCount atlas cells, pixels from pixelOffset
+struct cacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t format;
+	uint32_t levelCount;
+	uint64_t stamp;	// Hash of the sources' mtimes and sizes and the build parameters
+	uint32_t rectCount;
+	uint32_t reserved;
+	uint64_t pixelOffset;
+	uint64_t pixelSize;
+};
+constexpr uint32_t cacheVersion = 2;
+
+std::string cachePath(const char* source) {
+	return std::string(source) + ".tex";
+}
+
+bool sourceStamp(const char* source, int64_t* time, int64_t* size) {
+	struct stat st;
+	if (stat(source, &st)) return false;
+	*time = st.st_mtime;
+	*size = st.st_size;
+	return true;
+}
+
+// FNV-1a over every source's mtime and size and one build parameter. Missing sources
+// count as such, so the cache is rebuilt once they appear.
+uint64_t cacheStamp(const std::vector<const char*>& sources, int64_t parameter) {
+	uint64_t hash = 14695981039346656037ull;
+	auto mix = [&hash](int64_t value) {
+		for (int i = 0; i < 8; i++) {
+			hash ^= (uint64_t)value >> (8 * i) & 0xff;
+			hash *= 1099511628211ull;
+		}
+	};
+	for (const char* source : sources) {
+		int64_t time = -1, size = -1;
+		sourceStamp(source, &time, &size);
+		mix(time);
+		mix(size);
+	}
+	mix(parameter);
+	return hash;
+}
+
+// Every level has to lie inside the pixel block and be as large as its size and format imply
+bool validLevels(const mipLevel* levels, uint32_t count, GLenum format, uint64_t pixelSize) {
+	for (uint32_t i = 0; i < count; i++) {
+		const mipLevel& mip = levels[i];
+		if (mip.width <= 0 || mip.height <= 0) return false;
+		const unitGrid grid = levelGrid(format, mip.width, mip.height);
+		if (mip.size != grid.rows * grid.stride || mip.offset > pixelSize || mip.size > pixelSize - mip.offset) return false;
+	}
+	return true;
+}
+
+// Maps a valid cache file, the pixels are paged in lazily by the upload. Plain
+// texture caches carry no atlas cells, atlas caches one per source.
+bool mapCache(const std::string& path, GLenum format, uint64_t stamp, size_t rectCount,
+			  textureData* data, std::vector<atlasRect>* rects) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	void* mapping = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t)sizeof(cacheHeader))
+		mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) return false;
+
+	const unsigned char* bytes = (const unsigned char*)mapping;
+	const cacheHeader* header = (const cacheHeader*)bytes;
+	const mipLevel* levels = (const mipLevel*)(bytes + sizeof(cacheHeader));
+	const size_t levelsEnd = sizeof(cacheHeader) + header->levelCount * sizeof(mipLevel);
+	const size_t rectsEnd = levelsEnd + header->rectCount * sizeof(atlasRect);
+	if (memcmp(header->magic, "TEXC", 4) || header->version != cacheVersion
+		|| header->format != format || header->stamp != stamp || header->rectCount != rectCount
+		|| !header->levelCount || rectsEnd > header->pixelOffset || header->pixelOffset > (uint64_t)st.st_size
+		|| header->pixelOffset + header->pixelSize != (uint64_t)st.st_size
+		|| !validLevels(levels, header->levelCount, format, header->pixelSize)) {
+		munmap(mapping, st.st_size);
+		return false;
+	}
+
+	freeTextureData(data);
+	data->format = format;
+	data->levels.assign(levels, levels + header->levelCount);
+	data->mapped = bytes + header->pixelOffset;
+	data->mapping = mapping;
+	data->mappingSize = st.st_size;
+	if (rects) {
+		const atlasRect* cells = (const atlasRect*)(bytes + levelsEnd);
+		rects->assign(cells, cells + rectCount);
+	}
+	return true;
+}
+
+// Writes to a temporary file and renames it, so readers never see a partial cache
+void writeCache(const std::string& path, uint64_t stamp, const textureData& data, const std::vector<atlasRect>& rects) {
+	cacheHeader header = {};
+	memcpy(header.magic, "TEXC", 4);
+	header.version = cacheVersion;
+	header.format = data.format;
+	header.levelCount = data.levels.size();
+	header.stamp = stamp;
+	header.rectCount = rects.size();
+	const size_t rectsEnd = sizeof(cacheHeader) + data.levels.size() * sizeof(mipLevel) + rects.size() * sizeof(atlasRect);
+	header.pixelOffset = (rectsEnd + 15) & ~15;
+	header.pixelSize = data.pixels.size();
+
+	const std::string temp = path + ".tmp";
+	FILE* file = fopen(temp.c_str(), "wb");
+	if (!file) return;
+	const char padding[16] = {};
+	bool ok = fwrite(&header, sizeof header, 1, file) == 1
+		&& fwrite(data.levels.data(), sizeof(mipLevel), data.levels.size(), file) == data.levels.size()
+		&& fwrite(rects.data(), sizeof(atlasRect), rects.size(), file) == rects.size()
+		&& fwrite(padding, 1, header.pixelOffset - rectsEnd, file) == header.pixelOffset - rectsEnd
+		&& fwrite(data.pixels.data(), 1, data.pixels.size(), file) == data.pixels.size();
+	ok = !fclose(file) && ok;
+	if (!ok || rename(temp.c_str(), path.c_str())) remove(temp.c_str());
+}
+
+bool loadTextureCache(const char* source, GLenum format, textureData* data) {
+	return mapCache(cachePath(source), format, cacheStamp({ source }, 0), 0, data, nullptr);
+}
+
+void saveTextureCache(const char* source, const textureData& data) {
+	writeCache(cachePath(source), cacheStamp({ source }, 0), data, {});
+}
+
+bool loadAtlasCache(const char* path, const std::vector<const char*>& sources, GLsizei padding, GLenum format,
+					textureData* data, std::vector<atlasRect>* rects) {
+	if (!mapCache(path, format, cacheStamp(sources, padding), sources.size(), data, rects)) return false;
+	// Cells have to fit the top level, or the regions would sample outside the atlas
+	for (const atlasRect& rect : *rects) {
+		if (rect.x >= 0 && rect.y >= 0 && rect.width > 0 && rect.height > 0
+			&& rect.width <= data->levels[0].width - rect.x && rect.height <= data->levels[0].height - rect.y) continue;
+		freeTextureData(data);
+		return false;
+	}
+	return true;
+}
+
+void saveAtlasCache(const char* path, const std::vector<const char*>& sources, GLsizei padding, const textureData& data,
+					const std::vector<atlasRect>& rects) {
+	writeCache(path, cacheStamp(sources, padding), data, rects);
+}
+
+GLsizei roundUp(GLsizei value, GLsizei step) {
+	return (value + step - 1) / step * step;
+}
+
+std::vector<atlasRect> packAtlas(const std::vector<atlasRect>& sizes, GLsizei padding, GLsizei* width, GLsizei* height) {
+	std::vector<atlasRect> cells(sizes.size());
+	std::vector<size_t> order(sizes.size());
+	GLsizei area = 0, widest = 0;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		cells[i].width = roundUp(sizes[i].width + 2 * padding, padding);
+		cells[i].height = roundUp(sizes[i].height + 2 * padding, padding);
+		area += cells[i].width * cells[i].height;
+		widest = std::max(widest, cells[i].width);
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return cells[a].height > cells[b].height;
+	});
+
+	// Power of two width that fits the widest cell and keeps the atlas roughly square
+	*width = 1;
+	while (*width < widest || *width * *width < area) *width *= 2;
+
+	GLsizei x = 0, y = 0, shelf = 0;
+	for (size_t i : order) {
+		if (x + cells[i].width > *width) {
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		cells[i].x = x;
+		cells[i].y = y;
+		x += cells[i].width;
+		shelf = std::max(shelf, cells[i].height);
+	}
+	*height = y + shelf;
+
+	std::vector<atlasRect> rects(sizes.size());
+	for (size_t i = 0; i < sizes.size(); i++)
+		rects[i] = { cells[i].x + padding, cells[i].y + padding, sizes[i].width, sizes[i].height };
+	return rects;
+}
+
+void buildAtlas(const std::vector<const textureData*>& sources, const std::vector<atlasRect>& rects,
+				GLsizei padding, GLsizei width, GLsizei height, textureData* atlas) {
+	const GLenum format = sources.front()->format;
+	const GLsizei unit = format == GL_RGB ? 1 : 4;
+	GLsizei align = padding;
+	for (auto& rect : rects) align = std::min({ align, rect.x & -rect.x, rect.y & -rect.y });
+	for (GLsizei size : { width, height }) align = std::min(align, size & -size);
+
+	freeTextureData(atlas);
+	atlas->format = format;
+	for (GLsizei k = 0; unit << k <= align; k++) {
+		const GLsizei levelWidth = width >> k, levelHeight = height >> k;
+		const unitGrid grid = levelGrid(format, levelWidth, levelHeight);
+		const mipLevel mip = { levelWidth, levelHeight, atlas->pixels.size(), grid.rows * grid.stride };
+		atlas->pixels.resize(mip.offset + mip.size);
+		atlas->levels.push_back(mip);
+		unsigned char* out = atlas->pixels.data() + mip.offset;
+
+		const GLsizei border = (padding >> k) / unit;
+		for (size_t i = 0; i < sources.size(); i++) {
+			const textureData& source = *sources[i];
+			const mipLevel& from = source.levels[std::min<size_t>(k, source.levels.size() - 1)];
+			const unitGrid sourceGrid = levelGrid(format, from.width, from.height);
+			const unsigned char* in = texturePixels(source) + from.offset;
+			const GLsizei x0 = (rects[i].x >> k) / unit, y0 = (rects[i].y >> k) / unit;
+			const GLsizei columns = std::max<GLsizei>(1, (rects[i].width >> k) / unit);
+			const GLsizei rows = std::max<GLsizei>(1, (rects[i].height >> k) / unit);
+
+			for (GLsizei y = -border; y < rows + border; y++) {
+				const GLsizei sourceY = std::min(std::max(y, 0), sourceGrid.rows - 1);
+				for (GLsizei x = -border; x < columns + border; x++) {
+					const GLsizei sourceX = std::min(std::max(x, 0), sourceGrid.columns - 1);
+					memcpy(out + (y0 + y) * grid.stride + (x0 + x) * grid.unitBytes,
+						in + sourceY * sourceGrid.stride + sourceX * grid.unitBytes, grid.unitBytes);
+				}
+			}
+		}
+	}
+}
\ No newline at end of file
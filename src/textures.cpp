@@ -1,65 +1,225 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "include/textures.h"
-#include "include/RgbImage.h"
+#include "include/texturedata.h"
+
+GLuint atlas;
+atlasRegion wood, metal, skyBoxTex, flooring;
+bool compressTextures = false;
+
+struct textureJob {
+	const char* filename;
+	atlasRegion* region;
+	textureData data;
+};
+
+textureJob jobs[] = {
+	{ "assets/wood.bmp", &wood, {} },
+	{ "assets/metal.bmp", &metal, {} },
+	{ "assets/skybox.bmp", &skyBoxTex, {} },
+	{ "assets/floor.bmp", &flooring, {} }
+};
+constexpr int jobCount = sizeof jobs / sizeof *jobs;
+
+// The packed atlas is cached too, a hit skips decoding and packing altogether
+const char* const atlasCache = "assets/atlas.tex";
+
+std::vector<const char*> jobSources() {
+	std::vector<const char*> sources;
+	for (auto& job : jobs) sources.push_back(job.filename);
+	return sources;
+}
+
+// Border around every atlas cell, keeps filtering and the first mip levels from bleeding
+constexpr GLsizei atlasPadding = 32;
+
+// Decoding runs on worker threads, the last one to finish packs the atlas,
+// the upload happens on the GL thread
+struct {
+	std::atomic<int> next{0};
+	std::atomic<int> remaining{0};
+	std::mutex lock;
+	std::vector<std::thread> workers;
+	std::atomic<bool> stop{false};	// Set at exit, workers finish their current job and return
+	bool ready = false;
+	bool done = false;
+	textureData data;
+	std::vector<atlasRect> rects;
+	GLsizei width = 0, height = 0;
+	GLuint pbo = 0;
+	bool compress = false;
+} loader;
+
+// Sources that failed to load get a grey cell, like the startup placeholder
+void packTextures() {
+	textureData placeholder;
+	RgbImage grey(1, 1);
+	memset(grey.GetRgbPixel(0, 0), 128, 3);
+	buildTextureData(grey, loader.compress, &placeholder);
+
+	std::vector<const textureData*> sources;
+	std::vector<atlasRect> sizes;
+	for (auto& job : jobs) {
+		const textureData* source = job.data.levels.empty() ? &placeholder : &job.data;
+		sources.push_back(source);
+		sizes.push_back({ 0, 0, source->levels[0].width, source->levels[0].height });
+	}
+
+	textureData packed;
+	GLsizei width, height;
+	std::vector<atlasRect> rects = packAtlas(sizes, atlasPadding, &width, &height);
+	buildAtlas(sources, rects, atlasPadding, width, height, &packed);
+	for (auto& job : jobs) freeTextureData(&job.data);
+	saveAtlasCache(atlasCache, jobSources(), atlasPadding, packed, rects);
+
+	std::lock_guard<std::mutex> guard(loader.lock);
+	loader.data = std::move(packed);
+	loader.rects = std::move(rects);
+	loader.width = width;
+	loader.height = height;
+	loader.ready = true;
+}
+
+void decodeTextures() {
+	const GLenum format = loader.compress ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB;
+	for (int i = loader.next++; i < jobCount && !loader.stop; i = loader.next++) {
+		if (!loadTextureCache(jobs[i].filename, format, &jobs[i].data)) {
+			RgbImage image;
+			if (image.LoadBmpFile(jobs[i].filename)) {
+				buildTextureData(image, loader.compress, &jobs[i].data);
+				saveTextureCache(jobs[i].filename, jobs[i].data);
+			}
+		}
+		if (--loader.remaining == 0) packTextures();
+	}
+}
+
+// A cached atlas uploads straight from the file mapping, a freshly packed one streams
+// every mip level through one pixel buffer object. Frees the CPU copy.
+void upload(textureData& data) {
+	const unsigned char* base = data.mapped;
+	if (!base) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, loader.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, data.pixels.size(), NULL, GL_STREAM_DRAW);
+		void* pixels = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (!pixels) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			freeTextureData(&data);
+			return;
+		}
+		memcpy(pixels, data.pixels.data(), data.pixels.size());
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, atlas);
+	for (size_t i = 0; i < data.levels.size(); i++) {
+		const mipLevel& mip = data.levels[i];
+		// An address in the mapping, or an offset into the bound pixel buffer
+		const void* pixels = base ? (const void*)(base + mip.offset) : (const void*)(uintptr_t)mip.offset;
+		if (data.format == GL_RGB)
+			glTexImage2D(
+				GL_TEXTURE_2D, i, GL_RGB8, mip.width, mip.height,
+				0, GL_RGB, GL_UNSIGNED_BYTE, pixels
+			);
+		else
+			glCompressedTexImage2D(
+				GL_TEXTURE_2D, i, data.format, mip.width, mip.height,
+				0, mip.size, pixels
+			);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data.levels.size() - 1);
+
+	for (int i = 0; i < jobCount; i++) {
+		const atlasRect& rect = loader.rects[i];
+		*jobs[i].region = {
+			{ (GLfloat)rect.width / loader.width, (GLfloat)rect.height / loader.height },
+			{ (GLfloat)rect.x / loader.width, (GLfloat)rect.y / loader.height }
+		};
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	freeTextureData(&data);
+}
 
-GLuint wood, metal, skyBoxTex, flooring;
+bool hasExtension(const char* name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+		if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name)) return true;
+	return false;
+}
 
+// Exiting with joinable threads terminates, so quitting mid-decode joins them first
+void stopTextures() {
+	loader.stop = true;
+	for (auto& worker : loader.workers) worker.join();
+	loader.workers.clear();
+}
+
+// Creates the atlas with a 1x1 placeholder and starts decoding in the background
 void initTextures() {
-	RgbImage img;
-	img.LoadBmpFile("assets/wood.bmp");
-	glGenTextures(1, &wood);
-	glBindTexture(GL_TEXTURE_2D, wood);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(
-		GL_TEXTURE_2D, 0, GL_RGBA,
-		img.GetNumCols(), img.GetNumRows(),
-		0, GL_RGB, GL_UNSIGNED_BYTE, img.ImageData()
-	);
-
-	img.LoadBmpFile("assets/metal.bmp");
-	glGenTextures(1, &metal);
-	glBindTexture(GL_TEXTURE_2D, metal);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(
-		GL_TEXTURE_2D, 0, GL_RGBA,
-		img.GetNumCols(), img.GetNumRows(),
-		0, GL_RGB, GL_UNSIGNED_BYTE, img.ImageData()
-	);
-
-	img.LoadBmpFile("assets/skybox.bmp");
-	glGenTextures(1, &skyBoxTex);
-	glBindTexture(GL_TEXTURE_2D, skyBoxTex);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(
-		GL_TEXTURE_2D, 0, GL_RGBA,
-		img.GetNumCols(), img.GetNumRows(),
-		0, GL_RGB, GL_UNSIGNED_BYTE, img.ImageData()
-	);
-
-	img.LoadBmpFile("assets/floor.bmp");
-	glGenTextures(1, &flooring);
-	glBindTexture(GL_TEXTURE_2D, flooring);
+	const GLubyte placeholder[] = { 128, 128, 128 };
+	// llvmpipe's anisotropic sampler stalls for minutes on faces seen almost edge-on, and
+	// software rasterisers pay for every extra sample anyway
+	const char* renderer = (const char*)glGetString(GL_RENDERER);
+	const bool software = renderer && (strstr(renderer, "llvmpipe") || strstr(renderer, "softpipe"));
+	GLfloat anisotropy = 0;
+	if (!software && hasExtension("GL_EXT_texture_filter_anisotropic")) {
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisotropy);
+		anisotropy = std::min(anisotropy, 8.0f);
+	}
+	loader.compress = compressTextures && hasExtension("GL_EXT_texture_compression_s3tc");
+
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glGenTextures(1, &atlas);
+	glBindTexture(GL_TEXTURE_2D, atlas);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(
-		GL_TEXTURE_2D, 0, GL_RGBA,
-		img.GetNumCols(), img.GetNumRows(),
-		0, GL_RGB, GL_UNSIGNED_BYTE, img.ImageData()
-	);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	if (anisotropy > 1) glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisotropy);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, placeholder);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenBuffers(1, &loader.pbo);
+
+	const GLenum format = loader.compress ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGB;
+	if (loadAtlasCache(atlasCache, jobSources(), atlasPadding, format, &loader.data, &loader.rects)) {
+		loader.width = loader.data.levels[0].width;
+		loader.height = loader.data.levels[0].height;
+		loader.ready = true;
+		return;
+	}
+
+	loader.remaining = jobCount;
+	atexit(stopTextures);
+	const int threads = std::max(1, std::min<int>(jobCount, std::thread::hardware_concurrency()));
+	for (int i = 0; i < threads; i++) loader.workers.emplace_back(decodeTextures);
+}
+
+// Uploads the atlas once it is packed, returns true once that is done
+bool pollTextures() {
+	if (loader.done) return true;
+	{
+		std::lock_guard<std::mutex> guard(loader.lock);
+		if (!loader.ready) return false;
+	}
+
+	for (auto& worker : loader.workers) worker.join();
+	loader.workers.clear();
+	upload(loader.data);
+	glDeleteBuffers(1, &loader.pbo);
+	loader.done = true;
+	return true;
+}
+
+// Blocks until the atlas is uploaded (headless and benchmark runs)
+void finishTextures() {
+	while (!pollTextures()) std::this_thread::yield();
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include <cstring>
+#include <vector>
+
+#include "include/transforms.h"
+#include "include/vecmath.h"
+
+struct {
+	const int32_t* parent = nullptr;
+	uint32_t count = 0;
+	std::vector<GLfloat> translate, rotate, scale;	// 3, 4 and 3 per node
+	std::vector<mat4> world;
+	std::vector<GLfloat> normal;	// 9 per node
+	std::vector<GLboolean> dirty;
+	std::vector<GLboolean> rebuilt;	// By the last update
+	bool changed = false;	// Any node dirty since the last update
+	transformStats stats;
+} hierarchy;
+
+// Normal matrix from the upper 3x3 of a column-major transform. The cofactor matrix
+// is the inverse transpose up to scale, which the shaders normalise away.
+void normalMatrix(const GLfloat* m, GLfloat* normal) {
+	const GLfloat* a = m;
+	const GLfloat* b = m + 4;
+	const GLfloat* c = m + 8;
+	const GLfloat columns[3][3] = {
+		{ b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0] },
+		{ c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0] },
+		{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] }
+	};
+	const GLfloat sign = a[0] * columns[0][0] + a[1] * columns[0][1] + a[2] * columns[0][2] < 0 ? -1 : 1;
+	for (int i = 0; i < 9; i++) normal[i] = sign * columns[i / 3][i % 3];
+}
+
+void resetTransforms(const int32_t* parent, uint32_t count) {
+	hierarchy.parent = parent;
+	hierarchy.count = count;
+	hierarchy.translate.assign(3 * count, 0);
+	hierarchy.rotate.assign(4 * count, 0);
+	hierarchy.scale.assign(3 * count, 1);
+	hierarchy.world.resize(count);
+	hierarchy.normal.resize(9 * count);
+	hierarchy.dirty.assign(count, true);
+	hierarchy.rebuilt.assign(count, false);
+	hierarchy.changed = true;
+	hierarchy.stats = { count, 0 };
+}
+
+// Only marks the node dirty when the transform actually differs
+void setLocal(uint32_t node, const GLfloat* translate, const GLfloat* rotate, const GLfloat* scale) {
+	GLfloat* t = &hierarchy.translate[3 * node];
+	GLfloat* r = &hierarchy.rotate[4 * node];
+	GLfloat* s = &hierarchy.scale[3 * node];
+	if (!memcmp(t, translate, 3 * sizeof(GLfloat)) && !memcmp(r, rotate, 4 * sizeof(GLfloat))
+		&& !memcmp(s, scale, 3 * sizeof(GLfloat))) return;
+	memcpy(t, translate, 3 * sizeof(GLfloat));
+	memcpy(r, rotate, 4 * sizeof(GLfloat));
+	memcpy(s, scale, 3 * sizeof(GLfloat));
+	hierarchy.dirty[node] = true;
+	hierarchy.changed = true;
+}
+
+// One top-down pass, flags stay set until its end so dirty parents carry their children along
+void updateTransforms() {
+	if (hierarchy.stats.updated) hierarchy.rebuilt.assign(hierarchy.count, false);
+	hierarchy.stats.updated = 0;
+	if (!hierarchy.changed) return;
+	hierarchy.changed = false;
+
+	for (uint32_t i = 0; i < hierarchy.count; i++) {
+		const int32_t parent = hierarchy.parent[i];
+		if (parent >= 0 && hierarchy.dirty[parent]) hierarchy.dirty[i] = true;
+		if (!hierarchy.dirty[i]) continue;
+
+		const GLfloat* t = &hierarchy.translate[3 * i];
+		const GLfloat* r = &hierarchy.rotate[4 * i];
+		const GLfloat* s = &hierarchy.scale[3 * i];
+		const mat4 local = compose({ t[0], t[1], t[2] }, axisAngle(r[0], { r[1], r[2], r[3] }), { s[0], s[1], s[2] });
+		mat4& world = hierarchy.world[i];
+		world = parent < 0 ? local : hierarchy.world[parent] * local;
+		normalMatrix(world.m, &hierarchy.normal[9 * i]);
+		hierarchy.stats.updated++;
+	}
+	hierarchy.rebuilt.swap(hierarchy.dirty);
+	hierarchy.dirty.assign(hierarchy.count, false);
+}
+
+const GLfloat* worldMatrix(uint32_t node) {
+	return hierarchy.world[node].m;
+}
+
+const GLfloat* worldNormal(uint32_t node) {
+	return &hierarchy.normal[9 * node];
+}
+
+bool worldRebuilt(uint32_t node) {
+	return hierarchy.rebuilt[node];
+}
+
+transformStats transformStatistics() {
+	return hierarchy.stats;
+}
\ No newline at end of file